@@ -6,14 +6,18 @@
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include "tb_allocator.h"
 
-#define ALIGNMENT 16
+// ALIGNMENT, HEAP_SIZE and the block sizes come from tb_allocator.h
 #define HEADER_SIZE sizeof(header_t)
-
-#define HEAP_SIZE (1 << 20)  // 1MB heap
-#define MIN_BLOCK_SIZE (1 << 5)  // 32 bytes
-#define MAX_BLOCK_SIZE (1 << 20) // 1MB
 #define LEVELS (__builtin_ctz(MAX_BLOCK_SIZE) - __builtin_ctz(MIN_BLOCK_SIZE) + 1)
+#define MAX_ARENAS 64        // Per allocator
+#define MAX_TOTAL_ARENAS 1024  // Across all allocators
+#define ARENA_TABLE_SIZE (MAX_TOTAL_ARENAS * 4)  // Open-addressed; kept at most a quarter full
+#define ARENA_TOMBSTONE ((arena_t*)(uintptr_t)1)  // Slot of an arena whose allocator was destroyed
+
+struct arena;
 
 // Special header for oversized allocations
 typedef struct oversized_header {
@@ -32,11 +36,46 @@ typedef union header {
     uint8_t padding[ALIGNMENT];
 } header_t;
 
-static header_t* free_lists[LEVELS] = { NULL };
-static oversized_header_t* oversized_blocks = NULL;
-static pthread_mutex_t allocator_lock = PTHREAD_MUTEX_INITIALIZER;
-static void* base_address = NULL;
-static int allocator_initialized = 0;
+// One HEAP_SIZE buddy heap. An allocator starts with one and tb_grow_heap adds more;
+// blocks never span arenas, so each keeps its own free lists.
+typedef struct arena {
+    uint8_t* base;
+    tb_allocator_t* owner;
+    header_t* free_lists[LEVELS];
+    // Level + 1 of the allocated block starting at each MIN_BLOCK_SIZE granule, 0 if none.
+    // Lets tb_block_of map any address to its block in LEVELS probes.
+    uint8_t block_levels[HEAP_SIZE / MIN_BLOCK_SIZE];
+} arena_t;
+
+// An independent buddy allocator: its own arenas, oversized blocks and lock. Arenas
+// are published by bumping arena_count after the arena is set up, so
+// tb_allocator_capacity can read the count without the lock.
+struct tb_allocator {
+    arena_t* arenas[MAX_ARENAS];
+    int arena_count;
+    oversized_header_t* oversized_blocks;
+    pthread_mutex_t lock;
+    int initialized;
+    struct tb_allocator* next;  // In the allocators list
+};
+
+// The allocator behind tb_malloc and every call passed NULL.
+static tb_allocator_t default_allocator = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Every arena of every allocator is aligned to HEAP_SIZE, which makes addr / HEAP_SIZE
+// its key in arena_table; filling a slot publishes the arena to lock-free lookups, so
+// tb_free and tb_block_of need not be told which allocator a block came from.
+// table_lock guards writing the table; it is taken last, inside any other lock.
+// registry_lock guards the list of allocators and is taken before theirs.
+static arena_t* arena_table[ARENA_TABLE_SIZE];
+static int total_arenas = 0;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static tb_allocator_t* allocators = &default_allocator;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline tb_allocator_t* resolve(tb_allocator_t* allocator) {
+    return allocator ? allocator : &default_allocator;
+}
 
 static inline size_t align_up(size_t size) {
     return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
@@ -63,27 +102,135 @@ void* tb_request_memory(size_t size) {
     return block == MAP_FAILED ? NULL : block;
 }
 
-void tb_initialize_allocator() {
-    if (allocator_initialized) return;
+// The arena whose buddy heap contains addr, or NULL. Lock-free; a few probes at most.
+static arena_t* arena_of(uintptr_t addr) {
+    uintptr_t key = addr / HEAP_SIZE;
+    for (size_t n = 0, i = key % ARENA_TABLE_SIZE; n < ARENA_TABLE_SIZE; n++, i = (i + 1) % ARENA_TABLE_SIZE) {
+        arena_t* arena = __atomic_load_n(&arena_table[i], __ATOMIC_ACQUIRE);
+        if (!arena) return NULL;
+        if (arena != ARENA_TOMBSTONE && (uintptr_t)arena->base / HEAP_SIZE == key) return arena;
+    }
+    return NULL;
+}
 
-    void *heap = tb_request_memory(HEAP_SIZE);
-    if (!heap) {
-        perror("Failed to initialize memory allocator");
-        return;
+// Maps HEAP_SIZE bytes aligned to HEAP_SIZE by over-mapping and trimming both ends.
+static void* request_aligned_heap(void) {
+    uint8_t* raw = tb_request_memory(2 * HEAP_SIZE);
+    if (!raw) return NULL;
+
+    uint8_t* heap = (uint8_t*)(((uintptr_t)raw + HEAP_SIZE - 1) & ~(uintptr_t)(HEAP_SIZE - 1));
+    if (heap > raw) munmap(raw, heap - raw);
+    if (heap + HEAP_SIZE < raw + 2 * HEAP_SIZE) munmap(heap + HEAP_SIZE, raw + HEAP_SIZE - heap);
+    return heap;
+}
+
+// Maps a new arena holding one free block of the largest level. Called with the
+// allocator's lock held.
+static arena_t* add_arena(tb_allocator_t* allocator) {
+    if (allocator->arena_count == MAX_ARENAS) return NULL;
+
+    pthread_mutex_lock(&table_lock);
+    int full = total_arenas == MAX_TOTAL_ARENAS;
+    if (!full) total_arenas++;
+    pthread_mutex_unlock(&table_lock);
+    if (full) return NULL;
+
+    arena_t* arena = tb_request_memory(sizeof(arena_t));
+    void* heap = request_aligned_heap();
+    if (!arena || !heap) {
+        if (arena) munmap(arena, sizeof(arena_t));
+        if (heap) munmap(heap, HEAP_SIZE);
+        pthread_mutex_lock(&table_lock);
+        total_arenas--;
+        pthread_mutex_unlock(&table_lock);
+        return NULL;
     }
-    base_address = heap;
+    arena->base = heap;
+    arena->owner = allocator;
 
-    header_t *block = (header_t*)heap;
+    header_t* block = (header_t*)heap;
     block->s.size = HEAP_SIZE - HEADER_SIZE;
     block->s.is_free = 1;
     block->s.next = NULL;
+    arena->free_lists[LEVELS - 1] = block;
+
+    // A tombstone can be refilled: probes for other keys pass over the slot either way
+    pthread_mutex_lock(&table_lock);
+    size_t i = (uintptr_t)heap / HEAP_SIZE % ARENA_TABLE_SIZE;
+    while (arena_table[i] && arena_table[i] != ARENA_TOMBSTONE) i = (i + 1) % ARENA_TABLE_SIZE;
+    __atomic_store_n(&arena_table[i], arena, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&table_lock);
+
+    allocator->arenas[allocator->arena_count] = arena;
+    __atomic_store_n(&allocator->arena_count, allocator->arena_count + 1, __ATOMIC_RELEASE);
+    return arena;
+}
+
+static int initialize(tb_allocator_t* allocator) {
+    if (__atomic_load_n(&allocator->initialized, __ATOMIC_ACQUIRE)) return 1;
 
-    free_lists[LEVELS - 1] = block;
-    allocator_initialized = 1;
+    pthread_mutex_lock(&allocator->lock);
+    if (!allocator->initialized) {
+        if (add_arena(allocator)) {
+            __atomic_store_n(&allocator->initialized, 1, __ATOMIC_RELEASE);
+        } else {
+            perror("Failed to initialize memory allocator");
+        }
+    }
+    pthread_mutex_unlock(&allocator->lock);
+    return allocator->initialized;
+}
+
+void tb_initialize_allocator() {
+    initialize(&default_allocator);
+}
+
+tb_allocator_t* tb_allocator_create(void) {
+    tb_allocator_t* allocator = calloc(1, sizeof(tb_allocator_t));
+    if (!allocator) return NULL;
+    pthread_mutex_init(&allocator->lock, NULL);
+    if (!initialize(allocator)) {
+        pthread_mutex_destroy(&allocator->lock);
+        free(allocator);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    allocator->next = allocators;
+    allocators = allocator;
+    pthread_mutex_unlock(&registry_lock);
+    return allocator;
+}
+
+// Adds another HEAP_SIZE arena. Returns 1 if the heap grew, 0 if it is at its limit
+// or the memory could not be mapped.
+int tb_allocator_grow(tb_allocator_t* allocator) {
+    allocator = resolve(allocator);
+    if (!allocator->initialized) {
+        return initialize(allocator);
+    }
+
+    pthread_mutex_lock(&allocator->lock);
+    arena_t* arena = add_arena(allocator);
+    pthread_mutex_unlock(&allocator->lock);
+    return arena != NULL;
+}
+
+int tb_grow_heap(void) {
+    return tb_allocator_grow(NULL);
+}
+
+// Total bytes of buddy heap across the allocator's arenas.
+size_t tb_allocator_capacity(tb_allocator_t* allocator) {
+    return (size_t)__atomic_load_n(&resolve(allocator)->arena_count, __ATOMIC_ACQUIRE) * HEAP_SIZE;
+}
+
+size_t tb_heap_capacity(void) {
+    return tb_allocator_capacity(NULL);
 }
 
 // Handle large allocations that exceed MAX_BLOCK_SIZE
-void* tb_malloc_large(size_t size) {
+static void* tb_malloc_large(tb_allocator_t* allocator, size_t size) {
     // Allocate memory for both the header and the requested size
     size_t total_size = size + sizeof(oversized_header_t);
     void* mem = tb_request_memory(total_size);
@@ -96,40 +243,45 @@ void* tb_malloc_large(size_t size) {
     header->address = mem;  // Store the original pointer for freeing later
 
     // Add to the oversized blocks list
-    pthread_mutex_lock(&allocator_lock);
-    header->next = oversized_blocks;
-    oversized_blocks = header;
-    pthread_mutex_unlock(&allocator_lock);
+    pthread_mutex_lock(&allocator->lock);
+    header->next = allocator->oversized_blocks;
+    allocator->oversized_blocks = header;
+    pthread_mutex_unlock(&allocator->lock);
 
     // Return the usable memory area
     return (void*)(header + 1);
 }
 
-void* tb_malloc(size_t size) {
+void* tb_allocator_malloc(tb_allocator_t* allocator, size_t size) {
     if (!size) return NULL;
 
     // Initialize allocator if not already done
-    if (!allocator_initialized) {
-        tb_initialize_allocator();
-        if (!allocator_initialized) return NULL;
-    }
+    allocator = resolve(allocator);
+    if (!initialize(allocator)) return NULL;
 
     // Check if allocation is too large for the buddy system
     if (size > MAX_BLOCK_SIZE - HEADER_SIZE) {
-        return tb_malloc_large(size);
+        return tb_malloc_large(allocator, size);
     }
 
-    pthread_mutex_lock(&allocator_lock);
+    pthread_mutex_lock(&allocator->lock);
 
+    // First fit across arenas, oldest first
     int level = size_to_level(size);
-    int i = level;
-    while (i < LEVELS && free_lists[i] == NULL) i++;
+    arena_t *arena = NULL;
+    int i = LEVELS;
+    for (int a = 0; a < allocator->arena_count && i == LEVELS; a++) {
+        arena = allocator->arenas[a];
+        i = level;
+        while (i < LEVELS && arena->free_lists[i] == NULL) i++;
+    }
 
     if (i == LEVELS) {
-        pthread_mutex_unlock(&allocator_lock);
+        pthread_mutex_unlock(&allocator->lock);
         return NULL;
     }
 
+    header_t **free_lists = arena->free_lists;
     header_t *block = free_lists[i];
     free_lists[i] = block->s.next;
     size_t block_size = level_to_size(i);
@@ -146,16 +298,36 @@ void* tb_malloc(size_t size) {
 
     block->s.size = level_to_size(level) - HEADER_SIZE;
     block->s.is_free = 0;
-    pthread_mutex_unlock(&allocator_lock);
+    arena->block_levels[((uintptr_t)block - (uintptr_t)arena->base) / MIN_BLOCK_SIZE] = level + 1;
+    pthread_mutex_unlock(&allocator->lock);
     return (void*)(block + 1);
 }
 
+void* tb_malloc(size_t size) {
+    return tb_allocator_malloc(NULL, size);
+}
+
+// The allocator whose oversized block starts with header, or NULL if none does.
+// Called with registry_lock held; oversized blocks are few, so the walk is short.
+static tb_allocator_t* oversized_owner(oversized_header_t* header) {
+    for (tb_allocator_t* allocator = allocators; allocator; allocator = allocator->next) {
+        pthread_mutex_lock(&allocator->lock);
+        oversized_header_t* curr = allocator->oversized_blocks;
+        while (curr && curr != header) {
+            curr = curr->next;
+        }
+        pthread_mutex_unlock(&allocator->lock);
+        if (curr) return allocator;
+    }
+    return NULL;
+}
+
 // Free a large allocation
-void tb_free_large(oversized_header_t* header) {
-    pthread_mutex_lock(&allocator_lock);
+static void tb_free_large(tb_allocator_t* allocator, oversized_header_t* header) {
+    pthread_mutex_lock(&allocator->lock);
 
     // Remove from the oversized blocks list
-    oversized_header_t** pp = &oversized_blocks;
+    oversized_header_t** pp = &allocator->oversized_blocks;
     while (*pp && *pp != header) {
         pp = &(*pp)->next;
     }
@@ -164,7 +336,7 @@ void tb_free_large(oversized_header_t* header) {
         *pp = header->next;
     }
 
-    pthread_mutex_unlock(&allocator_lock);
+    pthread_mutex_unlock(&allocator->lock);
 
     // Return the memory to the OS
     munmap(header->address, header->size + sizeof(oversized_header_t));
@@ -174,48 +346,43 @@ void tb_free(void *ptr) {
     if (!ptr) return;
 
     // Check if this might be a large allocation
-    uintptr_t ptr_addr = (uintptr_t)ptr;
-    if (ptr_addr < (uintptr_t)base_address ||
-        ptr_addr >= (uintptr_t)base_address + HEAP_SIZE) {
+    arena_t *arena = arena_of((uintptr_t)ptr);
+    if (!arena) {
 
         // This is likely a large allocation
         oversized_header_t* header = (oversized_header_t*)ptr - 1;
 
         // Validate that this is indeed one of our oversized blocks
-        pthread_mutex_lock(&allocator_lock);
-        oversized_header_t* curr = oversized_blocks;
-        int is_valid = 0;
+        pthread_mutex_lock(&registry_lock);
+        tb_allocator_t* owner = oversized_owner(header);
+        pthread_mutex_unlock(&registry_lock);
 
-        while (curr) {
-            if (curr == header) {
-                is_valid = 1;
-                break;
-            }
-            curr = curr->next;
-        }
-        pthread_mutex_unlock(&allocator_lock);
-
-        if (is_valid) {
-            tb_free_large(header);
+        if (owner) {
+            tb_free_large(owner, header);
             return;
         }
-        // If not valid, fall through to regular free
+        // Not ours at all
+        return;
     }
 
     header_t *block = (header_t*)ptr - 1;
     size_t block_size = block->s.size + HEADER_SIZE;
     int level = size_to_level(block->s.size);
 
-    pthread_mutex_lock(&allocator_lock);
+    uintptr_t base = (uintptr_t)arena->base;
+    header_t **free_lists = arena->free_lists;
+
+    pthread_mutex_lock(&arena->owner->lock);
     block->s.is_free = 1;
+    arena->block_levels[((uintptr_t)block - base) / MIN_BLOCK_SIZE] = 0;
 
     while (level < LEVELS - 1) {
-        uintptr_t offset = (uintptr_t)block - (uintptr_t)base_address;
+        uintptr_t offset = (uintptr_t)block - base;
         uintptr_t buddy_offset = offset ^ block_size;
-        header_t *buddy = (header_t*)((uintptr_t)base_address + buddy_offset);
+        header_t *buddy = (header_t*)(base + buddy_offset);
 
-        if ((uintptr_t) buddy < (uintptr_t) base_address ||
-            (uintptr_t) buddy >= (uintptr_t)base_address + HEAP_SIZE ||
+        if ((uintptr_t) buddy < base ||
+            (uintptr_t) buddy >= base + HEAP_SIZE ||
             !buddy->s.is_free || buddy->s.size != block->s.size) {
             break;
         }
@@ -240,33 +407,174 @@ void tb_free(void *ptr) {
 
     block->s.next = free_lists[level];
     free_lists[level] = block;
-    pthread_mutex_unlock(&allocator_lock);
+    pthread_mutex_unlock(&arena->owner->lock);
 }
 
-// Function to clean up the allocator (useful for preventing memory leaks)
-void tb_cleanup_allocator() {
-    pthread_mutex_lock(&allocator_lock);
+// Usable bytes of the block returned by tb_malloc, which may exceed the request.
+size_t tb_usable_size(void* ptr) {
+    if (!arena_of((uintptr_t)ptr)) {
+        return ((oversized_header_t*)ptr - 1)->size;
+    }
+    return ((header_t*)ptr - 1)->s.size;
+}
+
+// Maps an arbitrary address to the user pointer of the allocated block containing it,
+// or NULL if it lies in no live block. Constant time for the buddy heap: one probe per
+// level, at the only granule where a block of that level could start.
+void* tb_block_of(const void* ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    arena_t* arena = arena_of(addr);
+
+    if (arena) {
+        uintptr_t base = (uintptr_t)arena->base;
+        uintptr_t offset = addr - base;
+        for (int level = 0; level < LEVELS; level++) {
+            uintptr_t start = offset & ~(uintptr_t)(level_to_size(level) - 1);
+            if (arena->block_levels[start / MIN_BLOCK_SIZE] == level + 1) {
+                header_t* block = (header_t*)(base + start);
+                return addr >= (uintptr_t)(block + 1) ? (void*)(block + 1) : NULL;
+            }
+        }
+        return NULL;
+    }
+
+    // Oversized blocks are few; a short list walk is fine here
+    void* result = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (tb_allocator_t* allocator = allocators; allocator && !result; allocator = allocator->next) {
+        pthread_mutex_lock(&allocator->lock);
+        for (oversized_header_t* curr = allocator->oversized_blocks; curr; curr = curr->next) {
+            uintptr_t start = (uintptr_t)(curr + 1);
+            if (addr >= start && addr < start + curr->size) {
+                result = (void*)start;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&allocator->lock);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return result;
+}
+
+// The arena with the lowest base above after's, or the lowest of all if after is NULL.
+// Arenas are mapped wherever mmap puts them, so the order they were added in says
+// nothing about their addresses. Called with the allocator's lock held.
+static arena_t* next_arena(tb_allocator_t* allocator, arena_t* after) {
+    arena_t* next = NULL;
+    for (int a = 0; a < allocator->arena_count; a++) {
+        arena_t* arena = allocator->arenas[a];
+        if (after && arena->base <= after->base) continue;
+        if (!next || arena->base < next->base) next = arena;
+    }
+    return next;
+}
+
+// User pointer of the first allocated block of arena at or after block, or NULL.
+static void* first_allocated(arena_t* arena, header_t* block) {
+    uintptr_t end = (uintptr_t)arena->base + HEAP_SIZE;
+    while ((uintptr_t)block < end) {
+        if (!block->s.is_free) return (void*)(block + 1);
+        block = (header_t*)((uintptr_t)block + block->s.size + HEADER_SIZE);
+    }
+    return NULL;
+}
+
+// Iterates over the allocator's blocks: the buddy heap in ascending address order
+// using each block's header size, arenas lowest first, then the oversized blocks.
+// Pass NULL to start; returns NULL when done. Each step holds the allocator's lock,
+// so a concurrent tb_malloc or tb_free cannot split or merge a block while its
+// header is read. prev must still be allocated when passed in; the caller may free
+// it once it has fetched its successor.
+void* tb_allocator_next_block(tb_allocator_t* allocator, void* prev) {
+    allocator = resolve(allocator);
+    void* result = NULL;
+    arena_t* arena;
+    header_t* block;
+
+    pthread_mutex_lock(&allocator->lock);
+    if (!prev) {
+        arena = next_arena(allocator, NULL);
+        block = arena ? (header_t*)arena->base : NULL;
+    } else {
+        arena = arena_of((uintptr_t)prev);
+        if (!arena) {
+            oversized_header_t* next = ((oversized_header_t*)prev - 1)->next;
+            pthread_mutex_unlock(&allocator->lock);
+            return next ? (void*)(next + 1) : NULL;
+        }
+        header_t* curr = (header_t*)prev - 1;
+        block = (header_t*)((uintptr_t)curr + curr->s.size + HEADER_SIZE);
+    }
+
+    while (arena && !(result = first_allocated(arena, block))) {
+        arena = next_arena(allocator, arena);
+        block = arena ? (header_t*)arena->base : NULL;
+    }
+
+    if (!result && allocator->oversized_blocks) {
+        result = (void*)(allocator->oversized_blocks + 1);
+    }
+    pthread_mutex_unlock(&allocator->lock);
+    return result;
+}
+
+void* tb_next_block(void* prev) {
+    return tb_allocator_next_block(NULL, prev);
+}
+
+// Returns all of the allocator's memory to the OS and leaves it uninitialized.
+static void release(tb_allocator_t* allocator) {
+    pthread_mutex_lock(&table_lock);
+    for (size_t i = 0; i < ARENA_TABLE_SIZE; i++) {
+        if (arena_table[i] && arena_table[i] != ARENA_TOMBSTONE && arena_table[i]->owner == allocator) {
+            __atomic_store_n(&arena_table[i], ARENA_TOMBSTONE, __ATOMIC_RELEASE);
+        }
+    }
+    total_arenas -= allocator->arena_count;
+    pthread_mutex_unlock(&table_lock);
+
+    pthread_mutex_lock(&allocator->lock);
 
     // Free all oversized blocks
-    oversized_header_t* curr = oversized_blocks;
+    oversized_header_t* curr = allocator->oversized_blocks;
     while (curr) {
         oversized_header_t* next = curr->next;
         munmap(curr->address, curr->size + sizeof(oversized_header_t));
         curr = next;
     }
-    oversized_blocks = NULL;
+    allocator->oversized_blocks = NULL;
 
-    // Free the main heap
-    if (base_address) {
-        munmap(base_address, HEAP_SIZE);
-        base_address = NULL;
+    // Free the arenas
+    for (int i = 0; i < allocator->arena_count; i++) {
+        munmap(allocator->arenas[i]->base, HEAP_SIZE);
+        munmap(allocator->arenas[i], sizeof(arena_t));
+        allocator->arenas[i] = NULL;
     }
+    allocator->arena_count = 0;
+
+    allocator->initialized = 0;
+    pthread_mutex_unlock(&allocator->lock);
+}
+
+// Function to clean up the allocator (useful for preventing memory leaks)
+void tb_cleanup_allocator() {
+    release(&default_allocator);
+}
+
+void tb_allocator_destroy(tb_allocator_t* allocator) {
+    if (!allocator || allocator == &default_allocator) return;
 
-    // Reset free lists
-    for (int i = 0; i < LEVELS; i++) {
-        free_lists[i] = NULL;
+    pthread_mutex_lock(&registry_lock);
+    tb_allocator_t** pp = &allocators;
+    while (*pp && *pp != allocator) {
+        pp = &(*pp)->next;
+    }
+    if (*pp) {
+        *pp = allocator->next;
     }
+    pthread_mutex_unlock(&registry_lock);
 
-    allocator_initialized = 0;
-    pthread_mutex_unlock(&allocator_lock);
+    release(allocator);
+    pthread_mutex_destroy(&allocator->lock);
+    free(allocator);
 }
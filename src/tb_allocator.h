@@ -5,16 +5,43 @@
 #include <pthread.h>
 #include <sys/mman.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Configuration constants */
 #define ALIGNMENT 16
 #define HEAP_SIZE (1 << 20)  // 1MB
 #define MIN_BLOCK_SIZE (1 << 5)  // 32 bytes
 #define MAX_BLOCK_SIZE (1 << 20) // 1MB
 
+/* An independent allocator with its own arenas and lock. The plain functions
+ * below use the default allocator; the tb_allocator_* ones take NULL for it. */
+typedef struct tb_allocator tb_allocator_t;
+
 /* Public interface */
 void tb_initialize_allocator(void);
 void* tb_malloc(size_t size);
 void tb_free(void* ptr);
 void tb_cleanup_allocator(void);
+void* tb_request_memory(size_t size);
+void* tb_block_of(const void* ptr);
+size_t tb_usable_size(void* ptr);
+void* tb_next_block(void* prev);
+int tb_grow_heap(void);
+size_t tb_heap_capacity(void);
+
+/* Per-allocator interface. tb_free, tb_block_of and tb_usable_size take a block
+ * from any allocator. */
+tb_allocator_t* tb_allocator_create(void);
+void tb_allocator_destroy(tb_allocator_t* allocator);
+void* tb_allocator_malloc(tb_allocator_t* allocator, size_t size);
+void* tb_allocator_next_block(tb_allocator_t* allocator, void* prev);
+int tb_allocator_grow(tb_allocator_t* allocator);
+size_t tb_allocator_capacity(tb_allocator_t* allocator);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // TB_ALLOCATOR_H
@@ -0,0 +1,184 @@
+#ifndef TB_BUDDY_ARENA_HPP
+#define TB_BUDDY_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/* The buddy algorithm of tb_allocator.c as a class template, for small dedicated
+ * arenas - a pool per subsystem or per message - each sized for its use. The level
+ * count, block sizes and header size are constants of the instantiation, and a
+ * request's level is computed without branches. The heap is stored inline, so an
+ * arena can live on the stack or inside another object; dynamically allocated
+ * arenas with Align above alignof(std::max_align_t) need an aligned allocation.
+ *
+ * Unlike tb_malloc, an arena has no lock and no fallback for requests larger than
+ * its heap: callers sharing one between threads lock it themselves, and allocate
+ * returns nullptr once nothing large enough is free.
+ *
+ *     BuddyArena<64 * 1024, 64, 16> pool;
+ *     void *p = pool.allocate(100);   // A 128-byte block
+ *     pool.deallocate(p);
+ */
+
+namespace tb_detail {
+
+constexpr bool is_power_of_two(size_t x) {
+    return x && !(x & (x - 1));
+}
+
+constexpr size_t log2_exact(size_t x) {
+    return (size_t)__builtin_ctzll((unsigned long long)x);
+}
+
+// Smallest n with 2^n >= x, for x >= 2
+constexpr size_t log2_ceil(size_t x) {
+    return 64 - (size_t)__builtin_clzll((unsigned long long)(x - 1));
+}
+
+constexpr size_t align_up(size_t x, size_t align) {
+    return (x + align - 1) & ~(align - 1);
+}
+
+}  // namespace tb_detail
+
+template <size_t HeapBytes, size_t MinBlock = 32, size_t Align = 16>
+class BuddyArena {
+    struct block_fields {
+        uint32_t level;
+        uint32_t is_free;
+        block_fields *next;  // In the free list of its level
+    };
+
+public:
+    static_assert(tb_detail::is_power_of_two(HeapBytes), "HeapBytes must be a power of two");
+    static_assert(tb_detail::is_power_of_two(MinBlock), "MinBlock must be a power of two");
+    static_assert(tb_detail::is_power_of_two(Align) && Align >= alignof(block_fields),
+                  "Align must be a power of two no smaller than a pointer");
+
+    static constexpr size_t header_size = tb_detail::align_up(sizeof(block_fields), Align);
+    static constexpr size_t levels = tb_detail::log2_exact(HeapBytes) - tb_detail::log2_exact(MinBlock) + 1;
+    static constexpr size_t max_request = HeapBytes - header_size;
+
+    static_assert(MinBlock > header_size && MinBlock % Align == 0,
+                  "MinBlock must hold the block header and keep blocks aligned");
+    static_assert(HeapBytes >= MinBlock, "the heap must hold at least one block");
+
+    static constexpr size_t block_size(size_t level) {
+        return MinBlock << level;
+    }
+
+    /**
+     * Level of the smallest block that holds size bytes after the header. Valid
+     * for size <= max_request; multiplying by the comparison clamps small requests
+     * to level 0 without a branch.
+     */
+    static constexpr size_t level_for(size_t size) {
+        return (tb_detail::log2_ceil(size + header_size) - tb_detail::log2_exact(MinBlock)) *
+               (size + header_size > MinBlock);
+    }
+
+    BuddyArena() {
+        reset();
+    }
+
+    BuddyArena(const BuddyArena &) = delete;
+    BuddyArena &operator=(const BuddyArena &) = delete;
+
+    /**
+     * Frees every block at once, leaving a single free block of the whole heap.
+     */
+    void reset() {
+        for (size_t i = 0; i < levels; i++) {
+            free_lists_[i] = nullptr;
+        }
+        block_fields *block = new (heap_) block_fields();
+        block->level = levels - 1;
+        block->is_free = 1;
+        free_lists_[levels - 1] = block;
+    }
+
+    /**
+     * Returns an Align-aligned block of at least size bytes, or nullptr if size
+     * is 0, above max_request, or no block large enough is free.
+     */
+    void *allocate(size_t size) {
+        if (!size || size > max_request) return nullptr;
+
+        size_t level = level_for(size);
+        size_t i = level;
+        while (i < levels && !free_lists_[i]) i++;
+        if (i == levels) return nullptr;
+
+        block_fields *block = free_lists_[i];
+        free_lists_[i] = block->next;
+
+        // Split down to the requested level, freeing the upper halves
+        while (i > level) {
+            i--;
+            block_fields *buddy = new (reinterpret_cast<uint8_t *>(block) + block_size(i)) block_fields();
+            buddy->level = (uint32_t)i;
+            buddy->is_free = 1;
+            buddy->next = free_lists_[i];
+            free_lists_[i] = buddy;
+        }
+
+        block->level = (uint32_t)level;
+        block->is_free = 0;
+        return reinterpret_cast<uint8_t *>(block) + header_size;
+    }
+
+    /**
+     * Returns a block to the arena, merging it with its buddy for as long as the
+     * buddy is free. ptr must come from this arena's allocate, or be nullptr.
+     */
+    void deallocate(void *ptr) {
+        if (!ptr) return;
+
+        block_fields *block = header_of(ptr);
+        size_t level = block->level;
+        block->is_free = 1;
+
+        while (level < levels - 1) {
+            size_t offset = (size_t)(reinterpret_cast<uint8_t *>(block) - heap_);
+            block_fields *buddy = reinterpret_cast<block_fields *>(heap_ + (offset ^ block_size(level)));
+            if (!buddy->is_free || buddy->level != level) break;
+
+            block_fields **prev = &free_lists_[level];
+            while (*prev && *prev != buddy) {
+                prev = &(*prev)->next;
+            }
+            if (!*prev) break;
+            *prev = buddy->next;
+
+            if (buddy < block) block = buddy;
+            level++;
+            block->level = (uint32_t)level;
+        }
+
+        block->next = free_lists_[level];
+        free_lists_[level] = block;
+    }
+
+    /**
+     * Usable bytes of a block returned by allocate, which may exceed the request.
+     */
+    size_t usable_size(const void *ptr) const {
+        return block_size(header_of(ptr)->level) - header_size;
+    }
+
+    bool owns(const void *ptr) const {
+        return static_cast<const uint8_t *>(ptr) >= heap_ + header_size &&
+               static_cast<const uint8_t *>(ptr) < heap_ + HeapBytes;
+    }
+
+private:
+    static block_fields *header_of(const void *ptr) {
+        return reinterpret_cast<block_fields *>(reinterpret_cast<uintptr_t>(ptr) - header_size);
+    }
+
+    alignas(Align) uint8_t heap_[HeapBytes];
+    block_fields *free_lists_[levels];
+};
+
+#endif // TB_BUDDY_ARENA_HPP
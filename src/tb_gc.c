@@ -1,228 +1,3587 @@
-#ifndef TB_GC_H
-#define TB_GC_H
-
+#define _GNU_SOURCE // pthread_getattr_np
 #define MAX_ROOTS 1024
-#define MARK_STACK_SIZE 1024
+#define MARK_CHUNK_ENTRIES 256 // Entries per mark stack segment
+#define MARK_CHUNK_POOL 16     // Segments preallocated for the mark stack
+#define SHADOW_CHUNK_SLOTS 512 // Root slots per shadow stack segment
+#define SEMISPACE_SIZE (HEAP_SIZE / 2)
+#define TLAB_CHUNK_SIZE 8192                   // Buddy block size taken per TLAB refill
+#define TLAB_MAX_OBJECT (TLAB_CHUNK_SIZE / 4)  // Larger objects get a chunk of their own
+#define TLAB_GRANULE sizeof(void *)            // Object alignment within a chunk
+#define TLAB_GRANULES (TLAB_CHUNK_SIZE / TLAB_GRANULE)
+#define GC_CHUNK_MAGIC 0x6b6e756863627447ULL   // "Gtbchunk"; first word of every TLAB chunk
+#define GC_SLICE_CHECK 32                      // Objects scanned between clock reads in a slice
+#define GC_STEP_WORK 4096                      // Objects scanned or swept by one gc_collect_step
+#define GC_SCHED_HISTORY 1024                  // Quanta remembered for MMU accounting
+#define GC_PREEMPT_INTERVAL 64                 // Default objects between preemption polls
+#define GC_PREEMPT_MAX_WAIT_NS 100000ULL       // Default bound on a critical event's wait
+#define GC_FINALIZER_BATCH 64                  // Finalizers run per trip through gc_lock
+#define GC_BARRIER_CHUNK 510                   // Shaded pointers per write barrier buffer segment
+#define GC_LOS_THRESHOLD (32 * 1024)           // Objects this big get a mapping of their own
+#define GC_SCAN_CHUNK 128                      // Child slots per mark stack item, and per card
+#define GC_SIMD_MIN_SLOTS 8                    // Shorter children arrays skip the vector filter
+#define GC_PREFETCH_MAX 64                     // Capacity of the mark loop's prefetch FIFO; power of two
+#define GC_PREFETCH_DISTANCE 8                 // Default children between prefetch and inspection
+#define MARK_CARD_ONLY ((size_t)1 << (sizeof(size_t) * 8 - 1))  // Item scans one card, no more
+#define GC_LOS_PAGE 4096                       // Large-object mappings are multiples of this
+#define GC_LOS_CACHE_BYTES (16 * (size_t)HEAP_SIZE)  // Freed mappings kept for reuse at most
+
+/* Layout of object_t::header, low bits first:
+ *   [0..7]   state flags below
+ *   [8..31]  child count, or type id when GC_TYPED is set
+ *   [32..63] payload size in GC_GRANULE units
+ * A forwarded semispace object's header is instead its new address | GC_FORWARDED. */
+#define GC_MARKED    1ULL  // Reachable in the current cycle
+#define GC_FORWARDED 2ULL  // Semispace object that has been copied
+#define GC_SCANNED   4ULL  // Children have been pushed; cleared by sweep
+#define GC_FREE      8ULL  // Dead object left in place inside a TLAB chunk
+#define GC_AGE_SHIFT 4     // Two bits counting collections survived, saturating at 3
+#define GC_AGE_MASK  (3ULL << GC_AGE_SHIFT)
+#define GC_TYPED     64ULL // Count field holds a registered type id instead of a child count
+#define GC_COUNT_SHIFT 8
+#define GC_COUNT_MAX ((1ULL << 24) - 1)
+#define GC_SIZE_SHIFT 32
+#define GC_GRANULE sizeof(void *)
+#define GC_WEAK      128ULL // Child slots are weak: never traced, cleared when their target dies
+#define GC_MAX_TYPES 4096
+#define EPHEMERON_MIN_CAPACITY 16
+#define EPHEMERON_TOMBSTONE ((object_t *)(uintptr_t)1)  // Key of a removed entry
+#include "tb_gc.h"
 #include "tb_allocator.h"
+#include "tb_stats.h"
+#include "tb_simd.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <setjmp.h>
+#include <sched.h>
 #include <stdio.h>
+#include <sys/mman.h>
+
+// Objects are laid out as [header][payload][children]. The payload is rounded up to
+// a granule so the children array that follows it is pointer aligned. Typed objects
+// have no children array; their pointers live in the payload at offsets given by
+// their registered type. struct object itself is in tb_gc.h for the inline barrier.
+
+// How the marker finds the pointers of a typed object.
+typedef enum {
+    GC_SCAN_NONE,    // Pointer-free payload
+    GC_SCAN_BITMAP,  // All pointers within the first 64 words: one bit per word
+    GC_SCAN_OFFSETS  // Explicit byte offsets
+} gc_scan_kind_t;
 
-typedef struct object {
+typedef struct gc_type {
     size_t size;
-    uint8_t marked;
-    struct object **children;
-    size_t child_count;
-    struct object *next_object; // For tracking all allocated objects
-} object_t;
+    gc_scan_kind_t kind;
+    uint64_t bitmap;
+    size_t ptr_count;
+    size_t *offsets;  // Sorted; always kept so slots can be addressed by index
+} gc_type_t;
+
+static gc_type_t gc_types[GC_MAX_TYPES];
+static size_t gc_type_count = 0;
+
+static inline size_t obj_size(const object_t *obj) {
+    return (size_t)(obj->header >> GC_SIZE_SHIFT) * GC_GRANULE;
+}
+
+static inline size_t obj_child_count(const object_t *obj) {
+    return (obj->header & GC_TYPED) ? 0 : (size_t)((obj->header >> GC_COUNT_SHIFT) & GC_COUNT_MAX);
+}
+
+static inline gc_type_t *obj_type(const object_t *obj) {
+    return &gc_types[(obj->header >> GC_COUNT_SHIFT) & GC_COUNT_MAX];
+}
+
+static inline void *obj_data(object_t *obj) {
+    return obj + 1;
+}
+
+static inline object_t **obj_children(object_t *obj) {
+    return (object_t **)((uint8_t *)(obj + 1) + obj_size(obj));
+}
+
+static inline size_t object_total_size(size_t size, size_t child_slots) {
+    size_t payload = (size + GC_GRANULE - 1) & ~(size_t)(GC_GRANULE - 1);
+    return sizeof(object_t) + payload + sizeof(object_t *) * child_slots;
+}
+
+static inline size_t obj_extent(const object_t *obj) {
+    return sizeof(object_t) + obj_size(obj) + sizeof(object_t *) * obj_child_count(obj);
+}
+
+// Number of pointer slots, whether a children array or a typed pointer map.
+static inline size_t obj_slot_count(const object_t *obj) {
+    return (obj->header & GC_TYPED) ? obj_type(obj)->ptr_count : obj_child_count(obj);
+}
+
+static inline object_t **obj_slot(object_t *obj, size_t slot) {
+    if (obj->header & GC_TYPED) {
+        return (object_t **)((uint8_t *)obj_data(obj) + obj_type(obj)->offsets[slot]);
+    }
+    return obj_children(obj) + slot;
+}
+
+// Calls visit on the address of every pointer slot of obj, using the loop that
+// suits its layout. Inlined into each caller so visit is a direct call.
+static inline __attribute__((always_inline))
+void scan_object(object_t *obj, void (*visit)(object_t **slot)) {
+    if (!(obj->header & (GC_TYPED | GC_WEAK))) {
+        object_t **children = obj_children(obj);
+        for (size_t i = 0, n = obj_child_count(obj); i < n; i++) {
+            visit(&children[i]);
+        }
+        return;
+    }
+    if (obj->header & GC_WEAK) return;  // Cleared after marking instead
+
+    gc_type_t *type = obj_type(obj);
+    object_t **words = obj_data(obj);
+    switch (type->kind) {
+    case GC_SCAN_NONE:
+        break;
+    case GC_SCAN_BITMAP:
+        for (uint64_t bits = type->bitmap; bits; bits &= bits - 1) {
+            visit(&words[__builtin_ctzll(bits)]);
+        }
+        break;
+    case GC_SCAN_OFFSETS:
+        for (size_t i = 0; i < type->ptr_count; i++) {
+            visit((object_t **)((uint8_t *)words + type->offsets[i]));
+        }
+        break;
+    }
+}
+
+// One key/value pair of an ephemeron table.
+typedef struct {
+    object_t *key;    // NULL for a never-used slot, EPHEMERON_TOMBSTONE for a removed one
+    object_t *value;
+} gc_ephemeron_t;
+
+// Open-addressed, linearly probed table keyed by object address. The collector
+// keeps each value alive only while its key is, and removes entries whose key died.
+struct gc_ephemeron_table {
+    gc_ephemeron_t *entries;
+    size_t capacity;   // Power of two, or 0 before the first insertion
+    size_t count;      // Live entries
+    size_t used;       // Live entries and tombstones
+    struct gc_heap *heap;  // Heap whose collector sweeps the table; NULL once it is destroyed
+    struct gc_ephemeron_table *next;
+};
+
+// A finalizable object. The node moves from the registry to the queue when its object
+// is found dead, and is freed once the finalizer has run.
+typedef struct gc_finalizable {
+    object_t *obj;
+    gc_finalizer_t finalizer;
+    struct gc_finalizable *next;
+} gc_finalizable_t;
+
+// A unit of marking work: obj's slots from start on. Arrays of more than GC_SCAN_CHUNK
+// children are scanned one chunk per item, so no item costs more than that; a
+// MARK_CARD_ONLY item rescans a single card the write barrier dirtied.
+typedef struct {
+    object_t *obj;
+    size_t start;
+} mark_item_t;
+
+// One segment of the mark stack. Segments are chained downwards through prev.
+typedef struct mark_chunk {
+    struct mark_chunk *prev;
+    size_t top;
+    mark_item_t entries[MARK_CHUNK_ENTRIES];
+} mark_chunk_t;
+
+// Every GC object lives in a chunk: a buddy block that threads bump-allocate small
+// objects out of, or a block holding one large object. Objects are laid out back to
+// back from data[] to top, so the chunk can be walked by size; the starts bitmap
+// marks the granule of every live object for interior-pointer lookup, and the marks
+// bitmap those of the objects marked this cycle, so sweeping can split the chunk
+// into survivors and garbage a word of granules at a time.
+typedef struct gc_chunk {
+    uint64_t magic;
+    uint8_t *top;     // End of the objects allocated so far
+    uint8_t *limit;   // End of usable memory in the block
+    int owned;        // Still some thread's TLAB; never freed while set
+    int busy;         // Held by an allocation from claiming space to publishing the object, or by the sweeper
+    uint8_t large;    // Holds a single object too big for a TLAB
+    uint8_t mapped;   // ... in the large-object space rather than a buddy block
+    uint8_t promoted; // Region chunk some of whose objects escaped; kept when the region ends
+    uint32_t swept;   // Cycle epoch in which this chunk was last swept
+    size_t free_bytes;  // Held by objects swept as dead, which stay until the chunk is freed
+    struct gc_heap *heap;            // Heap whose allocator the chunk came from
+    struct gc_region *region;        // Region this chunk belongs to, or NULL for the heap
+    struct gc_chunk *region_next;    // Next chunk of the same region
+    struct gc_chunk *promote_next;   // Next chunk waiting to have its objects' children promoted
+    uint64_t starts[TLAB_GRANULES / 64];
+    uint64_t marks[TLAB_GRANULES / 64];
+    uint8_t data[];
+} gc_chunk_t;
+
+// Start of a mapping in the large-object space; the object's chunk follows it.
+// Live mappings are on los_objects, newest first, and in los_index, sorted by address
+// for interior-pointer lookup. Freed ones wait on los_cache for reuse or on
+// los_unmap_queue for the unmapper thread.
+typedef struct los_mapping {
+    struct los_mapping *prev;
+    struct los_mapping *next;
+    size_t bytes;      // Length of the mapping
+    struct gc_heap *heap;  // Heap whose object it holds or last held; NULL once that heap is gone
+    uint32_t cached;   // gc_cycles when it entered the cache
+    int queued;        // The barrier has queued the object for a card rescan
+    uint64_t *cards;   // One dirty bit per GC_SCAN_CHUNK child slots, after the object
+} los_mapping_t;
+
+// One segment of a thread's shadow stack. Segments are chained bottom to top
+// and are never freed while the thread lives, so popping and pushing across a
+// segment boundary costs nothing after the first time.
+typedef struct shadow_chunk {
+    struct shadow_chunk *next;
+    struct shadow_chunk *prev;
+    object_t **slots[SHADOW_CHUNK_SLOTS];
+} shadow_chunk_t;
+
+// One segment of a thread's write barrier buffer: a single-producer, single-consumer
+// queue of shaded pointers. The owning thread appends and links new segments; the
+// collector consumes under gc_lock and hands emptied segments back through the
+// thread's spare slot.
+typedef struct barrier_chunk {
+    struct barrier_chunk *next;  // Linked by the producer once this segment is full
+    size_t count;                // Entries written; published with release stores
+    object_t *entries[GC_BARRIER_CHUNK];
+} barrier_chunk_t;
+
+// An allocation region opened by gc_region_begin. Its chunks stay owned until the
+// region ends and are then freed whole, except those promoted to the heap.
+typedef struct gc_region {
+    struct gc_region *outer;  // Enclosing region on the same thread
+    gc_chunk_t *chunks;       // Every chunk of the region, newest first; linked under gc_lock
+    gc_chunk_t *current;      // Chunk being bump-allocated from; never a promoted one
+    int depth;                // 1 for an outermost region
+} gc_region_t;
+
+// Per-thread mutator state, linked into gc_threads on first use.
+typedef struct gc_thread {
+    shadow_chunk_t *shadow_bottom;
+    shadow_chunk_t *shadow_top;  // Segment holding the next free slot
+    size_t shadow_index;         // Next free slot within shadow_top
+    size_t shadow_depth;         // Total slots in use; published for the collector
+    uint8_t *stack_base;         // Highest address of the stack, set by gc_register_thread
+    uint8_t *saved_sp;           // Stack pointer recorded by the last gc_safepoint
+    jmp_buf saved_regs;          // Callee-saved registers recorded alongside saved_sp
+    gc_chunk_t *tlab;            // Chunk this thread is currently bump-allocating from
+    barrier_chunk_t *barrier_tail;   // Segment the write barrier appends to
+    barrier_chunk_t *barrier_head;   // Oldest segment not yet consumed; collector only
+    size_t barrier_consumed;         // Entries of barrier_head consumed; collector only
+    barrier_chunk_t *barrier_spare;  // Emptied segment handed back; exchanged atomically
+    gc_region_t *region;             // Innermost open region; changed under gc_lock
+    gc_chunk_t **region_table;       // This thread's region chunks by address; owner only
+    size_t region_table_capacity;
+    size_t region_table_count;
+    struct gc_heap *heap;            // Heap this state belongs to; NULL once it is destroyed
+    struct gc_thread *sibling;       // The same thread's state in another heap
+    int parked;                      // Stopped at a safepoint; written by the thread only
+    struct gc_thread *next;
+} gc_thread_t;
+
+// Where the incremental collector is in its cycle.
+typedef enum {
+    GC_PHASE_IDLE,
+    GC_PHASE_MARK,   // Tracing from the root snapshot; the write barrier is active
+    GC_PHASE_SWEEP   // Marking finished; chunks are being swept in address order
+} gc_phase_t;
+
+// How much a slice of collector work may do: stop after work objects have been
+// scanned or swept, or once the clock passes deadline (UINT64_MAX for none).
+typedef struct {
+    uint64_t deadline;
+    size_t work;
+    int preempted;   // Set when a critical event ended the slice
+} gc_budget_t;
+
+// One GC quantum run by the scheduler.
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} gc_quantum_t;
 
 /* ========================= GARBAGE COLLECTOR DATA STRUCTURES ========================= */
 
-static object_t *root_set[MAX_ROOTS];
-static size_t root_count = 0;
-static object_t *mark_stack[MARK_STACK_SIZE];
-static size_t mark_top = 0;
-static object_t *all_objects = NULL;  // Linked list of all allocated objects
-static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
-static int gc_collection_in_progress = 0;
+// Everything one heap needs to allocate and collect independently of the others:
+// its own allocator, roots, lock and collector state. Code runs against the calling
+// thread's current heap, `heap`; gc_heap_use and the gc_heap_* calls switch it.
+struct gc_heap {
+    tb_allocator_t *allocator;           // NULL for the process's default allocator
+    object_t *root_set[MAX_ROOTS];
+    size_t root_count;
+    mark_chunk_t mark_chunk_pool[MARK_CHUNK_POOL];
+    mark_chunk_t *mark_chunk_free;       // Unused segments from the pool
+    mark_chunk_t *mark_stack;            // Segment holding the top of the stack
+    int mark_stack_overflowed;           // Set when a push found the pool empty
+    object_t *prefetch_fifo[GC_PREFETCH_MAX];  // Children prefetched but not yet marked
+    size_t prefetch_head;                // Oldest entry of prefetch_fifo
+    size_t prefetch_count;
+    size_t prefetch_distance;            // 0 marks children as they are found
+    pthread_mutex_t gc_lock;
+    gc_phase_t gc_phase;
+    int barrier_active;                  // Set while marking; read by the barrier's slow path
+    uint32_t gc_epoch;                   // Bumped at the start of every cycle
+    gc_chunk_t *sweep_cursor;            // Next chunk the sweeper will visit
+    size_t gc_bytes_allocated;           // Grows at chunk granularity; atomic
+    size_t gc_bytes_at_cycle_end;        // gc_bytes_allocated when the last cycle finished
+    size_t gc_heap_bytes;                // Bytes held by GC chunks right now; atomic
+    size_t cycle_work;                   // Objects scanned and swept by the cycle in flight
+    size_t last_cycle_work;              // ... and by the last complete one; 0 before the first
+    gc_mode_t gc_mode;
+    gc_thread_t *gc_threads;             // Every thread that has used the heap
+    int world_stopped;                   // A collector is waiting for, or holds, every thread parked
+    pthread_cond_t stop_cond;            // A thread parked or left while the world is stopping
+    pthread_cond_t resume_cond;          // The world is running again
+    int gc_conservative_roots;
+    los_mapping_t *los_objects;          // Live large objects, newest first; guarded by los_lock
+
+    /* Semispace state. Allocation bumps through ss_active; a collection copies
+     * survivors into ss_reserve and swaps the two. The previous active space keeps
+     * its forwarding pointers until the next collection so gc_forward can answer. */
+    uint8_t *ss_active;
+    uint8_t *ss_reserve;
+    uint8_t *ss_alloc_ptr;
+    uint8_t *ss_scan_ptr;
+    size_t ss_object_count;              // Objects in the active space, for freed counts
+
+    /* Statistics. Counters accumulate under gc_lock; percentiles are derived from
+     * the pause histogram when gc_get_stats is called. */
+    gc_stats_t gc_stats;
+    tb_histogram_t pause_histogram;
+    uint64_t cycle_root_scan_ns;         // Phase times of the cycle in flight
+    uint64_t cycle_mark_ns;
+    uint64_t cycle_sweep_ns;
+
+    /* Scheduler state, guarded by sched_lock. Only one thread runs quanta at a time;
+     * the others carry on with mutator work. */
+    pthread_mutex_t sched_lock;
+    int sched_enabled;
+    gc_scheduler_config_t sched_config;
+    gc_scheduler_stats_t sched_stats;
+    gc_quantum_t sched_history[GC_SCHED_HISTORY];
+    size_t sched_history_count;          // Total quanta recorded; index modulo the ring
+
+    /* Allocation pacing state, guarded by pace_lock. */
+    pthread_mutex_t pace_lock;
+    int pace_enabled;
+    gc_pacing_config_t pace_config;
+    gc_pacing_stats_t pace_stats;
+    size_t pace_last_bytes;              // gc_bytes_allocated at the last paced step
+
+    /* Heap sizing. heap_goal is the chunk footprint that triggers the next automatic
+     * collection; each cycle resets it from the live size and the measured GC cost,
+     * growing the allocator's heap when the goal outgrows it. Guarded by gc_lock. */
+    gc_heap_policy_t heap_policy;
+    size_t heap_goal;
+    uint64_t last_cycle_end_ns;
+    uint64_t cycle_start_bytes_marked;   // gc_stats.bytes_marked when the cycle began
+    int cycle_automatic;                 // Set while the policy itself is collecting
+
+    /* Weak references and ephemerons, guarded by gc_lock. Every object allocated with
+     * gc_alloc_weak is registered until it dies, so clearing never walks the heap. */
+    object_t **weak_objects;
+    size_t weak_count;
+    size_t weak_capacity;
+    gc_ephemeron_table_t *ephemeron_tables;
+
+    /* Finalization. Queued and running objects are roots until their finalizer has
+     * returned. The lists are guarded by gc_lock; finalizer_lock lets one thread at a
+     * time run finalizers, so the running batch needs no more than one list. */
+    gc_finalizable_t *finalizable;       // Registered, not found dead yet
+    gc_finalizable_t *finalize_queue;    // Found dead, waiting to run
+    gc_finalizable_t **finalize_queue_tail;
+    gc_finalizable_t *finalizing;        // Batch whose finalizers are running
+    pthread_mutex_t finalizer_lock;
+    pthread_cond_t finalizer_cond;       // Queue gained work, or stop
+    pthread_t finalizer_thread;
+    int finalizer_thread_running;
+    int finalizer_thread_stopping;
+
+    /* Preemption. The predicate is polled every preempt_interval objects of collector
+     * work; the interval starts at check_interval and adapts to keep the work between
+     * polls within max_wait_ns. Guarded by gc_lock. */
+    gc_preemption_config_t preemption;
+    size_t preempt_interval;
+    size_t preempt_since_poll;           // Objects since the last poll
+    uint64_t preempt_last_poll_ns;       // Time of the last poll, or the slice start
+
+    struct gc_heap *next;                // In the heaps list
+};
+
+#define DEFAULT_HEAP_POLICY {               \
+        .auto_collect = 1,                  \
+        .target_gc_ratio = 0.05,            \
+        .target_live_ratio = 0.5,           \
+        .max_heap_bytes = 64 * (size_t)HEAP_SIZE, \
+    }
+
+static const gc_heap_policy_t default_heap_policy = DEFAULT_HEAP_POLICY;
+
+// The default heap, the one every thread starts on. gc_heap_create sets up other
+// heaps the same way.
+static gc_heap_t default_heap = {
+    .prefetch_distance = GC_PREFETCH_DISTANCE,
+    .gc_lock = PTHREAD_MUTEX_INITIALIZER,
+    .stop_cond = PTHREAD_COND_INITIALIZER,
+    .resume_cond = PTHREAD_COND_INITIALIZER,
+    .gc_phase = GC_PHASE_IDLE,
+    .gc_mode = GC_MODE_MARK_SWEEP,
+    .sched_lock = PTHREAD_MUTEX_INITIALIZER,
+    .pace_lock = PTHREAD_MUTEX_INITIALIZER,
+    .heap_policy = DEFAULT_HEAP_POLICY,
+    .heap_goal = HEAP_SIZE / 2,
+    .finalize_queue_tail = &default_heap.finalize_queue,
+    .finalizer_lock = PTHREAD_MUTEX_INITIALIZER,
+    .finalizer_cond = PTHREAD_COND_INITIALIZER,
+    .preempt_interval = GC_PREEMPT_INTERVAL,
+};
+
+static __thread gc_heap_t *heap = &default_heap;   // Heap the calling thread is using
+static __thread gc_thread_t *current_thread = NULL; // The thread's state in that heap
+static __thread gc_thread_t *thread_states = NULL;  // ... and in every heap, via sibling
+__thread int gc_region_depth = 0;             // Read by the inline barrier
+static __thread gc_chunk_t *promote_list = NULL;  // Chunks promote_chunk has yet to scan
+static pthread_key_t gc_thread_key;
+static pthread_once_t gc_thread_key_once = PTHREAD_ONCE_INIT;
+
+/* Process-wide state shared by all heaps. */
+static gc_heap_t *gc_heaps = &default_heap;   // Every heap; guarded by heaps_lock
+static size_t gc_heap_count = 1;              // Length of gc_heaps; atomic
+static pthread_mutex_t heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+int gc_barrier_active = 0;                    // Heaps marking; read by the inline barrier
+static uintptr_t gc_heap_lo = UINTPTR_MAX;    // Lowest and highest address any chunk has covered,
+static uintptr_t gc_heap_hi = 0;              // for filtering child slots in bulk; atomic
+static uint32_t gc_cycles = 0;                // Cycles started by any heap; atomic
+static pthread_mutex_t type_lock = PTHREAD_MUTEX_INITIALIZER;  // Guards registering types
+
+/* Large-object space, guarded by los_lock. Sweeping moves dead mappings into the
+ * cache; what the cache cannot hold, or has held through a whole cycle without
+ * reuse, goes to a background thread so munmap never runs inside a pause. The
+ * index and cache are shared by every heap; each keeps its own list of objects. */
+static pthread_mutex_t los_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t los_cond = PTHREAD_COND_INITIALIZER;   // Unmap queue gained work
+static los_mapping_t **los_index = NULL;
+static size_t los_count = 0;                  // Mappings in los_index; read unlocked as a hint
+static size_t los_index_capacity = 0;
+static los_mapping_t *los_cache = NULL;       // Most recently freed first
+static size_t los_cache_bytes = 0;
+static los_mapping_t *los_unmap_queue = NULL;
+static gc_heap_t *los_unmapping_heap = NULL;   // Owner of the mapping being unmapped
+static int los_unmapper = 0;                  // 1 once the thread runs, -1 if it could not start
 
 /* ========================= GARBAGE COLLECTOR FUNCTIONS ========================= */
 
+static void semispace_init(void) {
+    if (!heap->ss_active) {
+        heap->ss_active = tb_request_memory(SEMISPACE_SIZE);
+        heap->ss_reserve = tb_request_memory(SEMISPACE_SIZE);
+        if (!heap->ss_active || !heap->ss_reserve) {
+            perror("Failed to initialize semispaces");
+            return;
+        }
+    }
+    heap->ss_alloc_ptr = heap->ss_active;
+    heap->ss_object_count = 0;
+}
+
+static void mark_stack_init(void) {
+    heap->mark_chunk_free = NULL;
+    for (size_t i = 0; i < MARK_CHUNK_POOL; i++) {
+        heap->mark_chunk_pool[i].prev = heap->mark_chunk_free;
+        heap->mark_chunk_free = &heap->mark_chunk_pool[i];
+    }
+    heap->mark_stack = NULL;
+    heap->mark_stack_overflowed = 0;
+}
+
+static void regions_hand_over(gc_thread_t *thread);
+
+// Turns the heap's write barrier on or off. The inline barrier tests how many heaps
+// have theirs on, and the slow path the flag of the heap the parent belongs to.
+// Called with gc_lock held.
+// Turning the barrier on is sequentially consistent, pairing with the inline barrier:
+// any store whose barrier still read it off is visible once the heap is scanned.
+static void set_barrier_active(int active) {
+    if (heap->barrier_active == active) return;
+    __atomic_store_n(&heap->barrier_active, active, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&gc_barrier_active, active ? 1 : -1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void free_finalizable_list(gc_finalizable_t *f) {
+    while (f) {
+        gc_finalizable_t *next = f->next;
+        free(f);
+        f = next;
+    }
+}
+
+void gc_init_mode(gc_mode_t mode) {
+    if (!heap->allocator) tb_initialize_allocator();
+    heap->root_count = 0;
+    mark_stack_init();
+    heap->gc_mode = mode;
+
+    // Abandon any cycle in flight; the chunks it has not swept are swept by the next
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->gc_phase = GC_PHASE_IDLE;
+    set_barrier_active(0);
+    heap->sweep_cursor = NULL;
+    heap->gc_bytes_at_cycle_end = __atomic_load_n(&heap->gc_bytes_allocated, __ATOMIC_RELAXED);
+    heap->cycle_work = heap->last_cycle_work = 0;
+    heap->last_cycle_end_ns = tb_now_ns();
+
+    // Like the roots, weak references, ephemerons and finalizers refer to the old heap
+    heap->weak_count = 0;
+    free_finalizable_list(heap->finalizable);
+    free_finalizable_list(heap->finalize_queue);
+    heap->finalizable = heap->finalize_queue = NULL;
+    heap->finalize_queue_tail = &heap->finalize_queue;
+    for (gc_ephemeron_table_t *table = heap->ephemeron_tables; table; table = table->next) {
+        if (table->entries) memset(table->entries, 0, sizeof(gc_ephemeron_t) * table->capacity);
+        table->count = table->used = 0;
+    }
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    // Start every thread on a fresh TLAB and empty regions; the old chunks become
+    // ordinary garbage
+    pthread_mutex_lock(&heap->gc_lock);
+    for (gc_thread_t *thread = heap->gc_threads; thread; thread = thread->next) {
+        if (thread->tlab) {
+            thread->tlab->owned = 0;
+            thread->tlab = NULL;
+        }
+        regions_hand_over(thread);
+    }
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    if (heap->gc_mode == GC_MODE_SEMISPACE) {
+        semispace_init();
+    }
+}
+
 void gc_init(void) {
-    tb_initialize_allocator();
-    root_count = 0;
-    mark_top = 0;
-    all_objects = NULL;
+    gc_init_mode(GC_MODE_MARK_SWEEP);
 }
 
 void gc_add_root(object_t *obj) {
     if (!obj) return;
 
-    pthread_mutex_lock(&gc_lock);
-    if (root_count < MAX_ROOTS) {
-        root_set[root_count++] = obj;
+    pthread_mutex_lock(&heap->gc_lock);
+    if (heap->root_count < MAX_ROOTS) {
+        heap->root_set[heap->root_count++] = obj;
     }
-    pthread_mutex_unlock(&gc_lock);
+    pthread_mutex_unlock(&heap->gc_lock);
     //printf("[DEBUG] Added root %p. Total roots: %zu\n", obj, root_count);
 }
 
 void gc_remove_root(object_t *obj) {
     if (!obj) return;
 
-    pthread_mutex_lock(&gc_lock);
-    for (size_t i = 0; i < root_count; i++) {
-        if (root_set[i] == obj) {
+    pthread_mutex_lock(&heap->gc_lock);
+    for (size_t i = 0; i < heap->root_count; i++) {
+        if (heap->root_set[i] == obj) {
             // Move the last root to this position and decrement count
-            root_set[i] = root_set[--root_count];
+            heap->root_set[i] = heap->root_set[--heap->root_count];
             break;
         }
     }
-    pthread_mutex_unlock(&gc_lock);
+    pthread_mutex_unlock(&heap->gc_lock);
 }
 
-void *gc_alloc(size_t size, size_t child_slots) {
-    // Calculate total size needed
-    size_t object_size = sizeof(object_t) + sizeof(object_t *) * child_slots + size;
+/* ========================= SAFEPOINTS ========================= */
 
-    // Allocate memory using the buddy allocator
-    object_t *obj = tb_malloc(object_size);
-    if (!obj) return NULL;
+// The final root scan of a cycle needs the mutators still: the collector sets
+// world_stopped and waits until every other thread of the heap that holds roots is
+// parked. A thread parks when it polls while a stop is pending, in gc_safepoint and
+// gc_blocking_begin, and in the heap it switches away from; it is running again once
+// it next calls into the collector, after waiting out any stop in progress. Only the
+// thread itself changes its parked flag. Both flags are sequentially consistent, so
+// a thread leaving its parked state either sees the stop or is seen running.
+//
+// A thread with no shadow stack roots and no registered stack has nothing for the
+// final scan to read, so it is not waited for - it may be blocked anywhere. Once it
+// pushes a root or registers, a stop already under way waits for it in turn.
 
-    // Initialize object fields
-    obj->size = size;
-    obj->marked = 0;
-    obj->child_count = child_slots;
-    obj->children = (object_t **)(obj + 1);
+// Parks thread until h is running again, then marks it running; a caller without
+// state in h just waits. Called with h's gc_lock held.
+static void wait_for_resume(gc_heap_t *h, gc_thread_t *thread) {
+    if (thread) {
+        __atomic_store_n(&thread->parked, 1, __ATOMIC_SEQ_CST);
+        pthread_cond_broadcast(&h->stop_cond);
+    }
+    while (__atomic_load_n(&h->world_stopped, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&h->resume_cond, &h->gc_lock);
+    }
+    if (thread) __atomic_store_n(&thread->parked, 0, __ATOMIC_SEQ_CST);
+}
+
+// Records the registers and stack pointer for conservative scanning before parking,
+// out of line so they cover everything the caller holds.
+__attribute__((noinline)) static void thread_park(gc_thread_t *thread) {
+    gc_heap_t *h = thread->heap;
+    setjmp(thread->saved_regs);
+    thread->saved_sp = __builtin_frame_address(0);
+    __atomic_store_n(&thread->parked, 1, __ATOMIC_SEQ_CST);
+    if (h && __atomic_load_n(&h->world_stopped, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&h->gc_lock);
+        pthread_cond_broadcast(&h->stop_cond);
+        pthread_mutex_unlock(&h->gc_lock);
+    }
+}
 
-    // Clear the children array
-    memset(obj->children, 0, sizeof(object_t *) * child_slots);
+static void thread_unpark(gc_thread_t *thread) {
+    gc_heap_t *h = thread->heap;
+    __atomic_store_n(&thread->parked, 0, __ATOMIC_SEQ_CST);
+    if (h && __atomic_load_n(&h->world_stopped, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&h->gc_lock);
+        wait_for_resume(h, thread);
+        pthread_mutex_unlock(&h->gc_lock);
+    }
+}
 
-    // Add to global object list for tracking
-    pthread_mutex_lock(&gc_lock);
-    obj->next_object = all_objects;
-    all_objects = obj;
-    pthread_mutex_unlock(&gc_lock);
+// Stops at a pending stop. Kept out of line so the registers and stack pointer it
+// saves cover everything the caller holds, for conservative scanning.
+__attribute__((noinline)) static void safepoint_park(gc_thread_t *thread) {
+    setjmp(thread->saved_regs);
+    thread->saved_sp = __builtin_frame_address(0);
+    pthread_mutex_lock(&heap->gc_lock);
+    wait_for_resume(heap, thread);
+    pthread_mutex_unlock(&heap->gc_lock);
+}
 
-    // Return pointer to user data area (after header and children array)
-    return (void*)(obj->children + child_slots);
+static inline void safepoint_poll(void) {
+    gc_thread_t *thread = current_thread;
+    if (thread && __atomic_load_n(&heap->world_stopped, __ATOMIC_ACQUIRE)) {
+        safepoint_park(thread);
+    }
 }
 
-static int is_tracked_object(object_t *obj) {
-    object_t *curr = all_objects;
-    while (curr) {
-        if (curr == obj) return 1;
-        curr = curr->next_object;
+// Takes a lock a collector may hold while it waits for this thread to stop, parked
+// for as long as the lock is contended.
+static void lock_parked(pthread_mutex_t *lock) {
+    if (pthread_mutex_trylock(lock) == 0) return;
+
+    gc_thread_t *thread = current_thread;
+    if (!thread || thread->parked) {
+        pthread_mutex_lock(lock);
+        return;
     }
-    return 0;
+    thread_park(thread);
+    pthread_mutex_lock(lock);
+    thread_unpark(thread);
 }
 
-static void push_mark_stack(object_t *obj) {
-    if (mark_top < MARK_STACK_SIZE) {
-        mark_stack[mark_top++] = obj;
-    } else {
-        // Mark stack overflow - process some objects immediately
-        for (size_t i = 0; i < mark_top / 2; i++) {
-            object_t *to_process = mark_stack[i];
-            for (size_t j = 0; j < to_process->child_count; j++) {
-                if (to_process->children[j] && !to_process->children[j]->marked) {
-                    to_process->children[j]->marked = 1;
-                }
-            }
+// Called by a thread that has just gained roots, after publishing them.
+static void thread_attached(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    safepoint_poll();
+}
+
+static int thread_stopped(gc_thread_t *thread) {
+    if (__atomic_load_n(&thread->parked, __ATOMIC_SEQ_CST)) return 1;
+    return __atomic_load_n(&thread->shadow_depth, __ATOMIC_SEQ_CST) == 0 &&
+           !__atomic_load_n(&thread->stack_base, __ATOMIC_SEQ_CST);
+}
+
+// Waits until every other thread of the heap is parked or holds no roots, and keeps
+// them there until resume_mutators. Called with gc_lock held, which is dropped while
+// waiting; a thread that takes it meanwhile to collect waits in run_slice.
+static void stop_mutators(void) {
+    __atomic_store_n(&heap->world_stopped, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+        gc_thread_t *thread = heap->gc_threads;
+        while (thread && (thread == current_thread || thread_stopped(thread))) {
+            thread = thread->next;
+        }
+        if (!thread) return;
+        pthread_cond_wait(&heap->stop_cond, &heap->gc_lock);
+    }
+}
+
+static void resume_mutators(void) {
+    __atomic_store_n(&heap->world_stopped, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&heap->resume_cond);
+}
+
+/* ========================= SHADOW STACK ========================= */
+
+static size_t drain_thread_barrier(gc_thread_t *thread);
+
+// Takes one of an exiting thread's states out of its heap, unless the heap has been
+// destroyed already, and frees it.
+static void gc_thread_release(gc_thread_t *thread) {
+    pthread_mutex_lock(&heaps_lock);
+    if (thread->heap) {
+        heap = thread->heap;
+        pthread_mutex_lock(&heap->gc_lock);
+        // Pointers this thread shaded are still owed to the marker
+        if (heap->gc_phase == GC_PHASE_MARK) {
+            drain_thread_barrier(thread);
+        }
+        gc_thread_t **pp = &heap->gc_threads;
+        while (*pp && *pp != thread) {
+            pp = &(*pp)->next;
         }
+        if (*pp) {
+            *pp = thread->next;
+            pthread_cond_broadcast(&heap->stop_cond);
+        }
+        if (thread->tlab) {
+            thread->tlab->owned = 0;
+        }
+        regions_hand_over(thread);
+        pthread_mutex_unlock(&heap->gc_lock);
+    }
+    pthread_mutex_unlock(&heaps_lock);
 
-        // Compress stack
-        mark_top /= 2;
-        mark_stack[mark_top++] = obj;
+    while (thread->region) {
+        gc_region_t *outer = thread->region->outer;
+        free(thread->region);
+        thread->region = outer;
+    }
+    free(thread->region_table);
+    shadow_chunk_t *chunk = thread->shadow_bottom;
+    while (chunk) {
+        shadow_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
+    for (barrier_chunk_t *b = thread->barrier_head; b;) {
+        barrier_chunk_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(thread->barrier_spare);
+    free(thread);
 }
 
-static object_t *pop_mark_stack(void) {
-    return (mark_top == 0) ? NULL : mark_stack[--mark_top];
+static void gc_thread_exit(void *arg) {
+    for (gc_thread_t *thread = arg; thread;) {
+        gc_thread_t *sibling = thread->sibling;
+        gc_thread_release(thread);
+        thread = sibling;
+    }
 }
 
-static void mark_object(object_t *obj) {
-    if (!obj || obj->marked || !is_tracked_object(obj)) {
-        return;
-    };
+static void gc_thread_key_create(void) {
+    pthread_key_create(&gc_thread_key, gc_thread_exit);
+}
+
+// Slow path taken once per thread and heap: allocate the thread's state in the current
+// heap and make it visible to the collector.
+static gc_thread_t *gc_thread_register(void) {
+    pthread_once(&gc_thread_key_once, gc_thread_key_create);
+
+    gc_thread_t *thread = calloc(1, sizeof(gc_thread_t));
+    shadow_chunk_t *chunk = calloc(1, sizeof(shadow_chunk_t));
+    barrier_chunk_t *barrier = calloc(1, sizeof(barrier_chunk_t));
+    if (!thread || !chunk || !barrier) {
+        free(thread);
+        free(chunk);
+        free(barrier);
+        return NULL;
+    }
+    thread->shadow_bottom = chunk;
+    thread->shadow_top = chunk;
+    thread->barrier_head = barrier;
+    thread->barrier_tail = barrier;
+
+    thread->heap = heap;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    thread->next = heap->gc_threads;
+    heap->gc_threads = thread;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    thread->sibling = thread_states;
+    thread_states = thread;
+    pthread_setspecific(gc_thread_key, thread);
+    current_thread = thread;
+    return thread;
+}
 
-    obj->marked = 1;
-    push_mark_stack(obj);
+// Makes h the heap the calling thread's GC calls act on, along with the thread's state
+// in it, if it has one yet. The thread counts as parked in the heap it leaves.
+static void heap_switch(gc_heap_t *h) {
+    if (current_thread && !current_thread->parked) {
+        thread_park(current_thread);
+    }
+    gc_thread_t *thread = thread_states;
+    while (thread && thread->heap != h) {
+        thread = thread->sibling;
+    }
+    heap = h;
+    current_thread = thread;
+    gc_region_depth = thread && thread->region ? thread->region->depth : 0;
+    if (thread && thread->parked) {
+        thread_unpark(thread);
+    }
 }
 
-static void mark_phase(void) {
-    pthread_mutex_lock(&gc_lock);
-    gc_collection_in_progress = 1;
+void gc_register_thread(void) {
+    gc_thread_t *thread = current_thread;
+    if (!thread && !(thread = gc_thread_register())) return;
 
-    // Mark from all roots
-    for (size_t i = 0; i < root_count; i++) {
-        mark_object(root_set[i]);
+    pthread_attr_t attr;
+    void *stack_lo;
+    size_t stack_size;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if (pthread_attr_getstack(&attr, &stack_lo, &stack_size) == 0) {
+            __atomic_store_n(&thread->stack_base, (uint8_t *)stack_lo + stack_size, __ATOMIC_SEQ_CST);
+        }
+        pthread_attr_destroy(&attr);
     }
+    thread_attached();
+}
+
+void gc_safepoint(void) {
+    gc_thread_t *thread = current_thread;
+    if (thread) thread_park(thread);
+}
 
-    // Process mark stack
-    while (mark_top > 0) {
-        object_t *obj = pop_mark_stack();
-        for (size_t i = 0; i < obj->child_count; i++) {
-            mark_object(obj->children[i]);
+void gc_blocking_begin(void) {
+    gc_safepoint();
+}
+
+void gc_blocking_end(void) {
+    gc_thread_t *thread = current_thread;
+    if (thread && thread->parked) thread_unpark(thread);
+}
+
+void gc_set_conservative_roots(int enabled) {
+    heap->gc_conservative_roots = enabled;
+}
+
+void gc_push_root(object_t **slot) {
+    gc_thread_t *thread = current_thread;
+    if (!thread && !(thread = gc_thread_register())) return;
+    if (thread->parked) thread_unpark(thread);
+
+    if (thread->shadow_index == SHADOW_CHUNK_SLOTS) {
+        shadow_chunk_t *next = thread->shadow_top->next;
+        if (!next) {
+            next = calloc(1, sizeof(shadow_chunk_t));
+            if (!next) return;
+            next->prev = thread->shadow_top;
+            // Publish the fully initialized segment before linking it in
+            __atomic_store_n(&thread->shadow_top->next, next, __ATOMIC_RELEASE);
         }
+        thread->shadow_top = next;
+        thread->shadow_index = 0;
     }
 
-    pthread_mutex_unlock(&gc_lock);
+    thread->shadow_top->slots[thread->shadow_index++] = slot;
+    __atomic_store_n(&thread->shadow_depth, thread->shadow_depth + 1, __ATOMIC_RELEASE);
+    if (thread->shadow_depth == 1 && !thread->stack_base) thread_attached();
 }
 
-static void sweep_phase(void) {
-    pthread_mutex_lock(&gc_lock);
+void gc_pop_roots(size_t n) {
+    gc_thread_t *thread = current_thread;
+    if (!thread) return;
+    if (thread->parked) thread_unpark(thread);
+    if (n > thread->shadow_depth) n = thread->shadow_depth;
+
+    __atomic_store_n(&thread->shadow_depth, thread->shadow_depth - n, __ATOMIC_RELEASE);
+    while (n > thread->shadow_index) {
+        n -= thread->shadow_index;
+        thread->shadow_top = thread->shadow_top->prev;
+        thread->shadow_index = SHADOW_CHUNK_SLOTS;
+    }
+    thread->shadow_index -= n;
+}
 
-    object_t **prev = &all_objects;
-    object_t *curr = all_objects;
+// Applies visit to every root - the global root set and each thread's shadow
+// stack - storing back whatever it returns. Called with gc_lock held.
+static void visit_roots(object_t *(*visit)(object_t *)) {
+    for (size_t i = 0; i < heap->root_count; i++) {
+        heap->root_set[i] = visit(heap->root_set[i]);
+    }
 
-    // Traverse all objects
-    while (curr) {
-        if (!curr->marked) {
-            // Not marked - remove from list and free
-            *prev = curr->next_object;
-            object_t *to_free = curr;
-            curr = curr->next_object;
-            tb_free(to_free);
-        } else {
-            // Marked - reset mark and move to next
-            curr->marked = 0;
-            prev = &curr->next_object;
-            curr = curr->next_object;
+    for (gc_thread_t *thread = heap->gc_threads; thread; thread = thread->next) {
+        size_t depth = __atomic_load_n(&thread->shadow_depth, __ATOMIC_ACQUIRE);
+        shadow_chunk_t *chunk = thread->shadow_bottom;
+        for (size_t i = 0; i < depth; i++) {
+            if (i && i % SHADOW_CHUNK_SLOTS == 0) {
+                chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE);
+            }
+            object_t **slot = chunk->slots[i % SHADOW_CHUNK_SLOTS];
+            *slot = visit(*slot);
         }
     }
 
-    gc_collection_in_progress = 0;
-    pthread_mutex_unlock(&gc_lock);
+    // Objects are kept alive from being found dead until their finalizer returns
+    for (gc_finalizable_t *f = heap->finalize_queue; f; f = f->next) {
+        f->obj = visit(f->obj);
+    }
+    for (gc_finalizable_t *f = heap->finalizing; f; f = f->next) {
+        f->obj = visit(f->obj);
+    }
+}
+
+/* ========================= ALLOCATION ========================= */
+
+static inline size_t ss_align(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
 }
 
-void gc_collect_step(void) {
-    // One incremental step of GC (simplified for this example)
-    mark_phase();
-    sweep_phase();
+static inline int in_semispace(const uint8_t *space, const void *ptr) {
+    return space && (const uint8_t *)ptr >= space &&
+           (const uint8_t *)ptr < space + SEMISPACE_SIZE;
 }
 
-void gc_collect_full(void) {
-    printf("=== Starting GC ===\n");
+static object_t *semispace_alloc(size_t object_size) {
+    size_t aligned = ss_align(object_size);
+
+    pthread_mutex_lock(&heap->gc_lock);
+    if (!heap->ss_alloc_ptr || (size_t)(heap->ss_active + SEMISPACE_SIZE - heap->ss_alloc_ptr) < aligned) {
+        pthread_mutex_unlock(&heap->gc_lock);
+        return NULL;
+    }
+    object_t *obj = (object_t *)heap->ss_alloc_ptr;
+    heap->ss_alloc_ptr += aligned;
+    heap->ss_object_count++;
+    pthread_mutex_unlock(&heap->gc_lock);
+    __atomic_fetch_add(&heap->gc_bytes_allocated, aligned, __ATOMIC_RELAXED);
+
+    return obj;
+}
+
+/* ========================= THREAD-LOCAL ALLOCATION ========================= */
 
-    mark_phase();
+static inline size_t tlab_align(size_t size) {
+    return (size + TLAB_GRANULE - 1) & ~(size_t)(TLAB_GRANULE - 1);
+}
+
+static inline size_t chunk_granule(gc_chunk_t *chunk, const void *ptr) {
+    return (size_t)((const uint8_t *)ptr - chunk->data) / TLAB_GRANULE;
+}
 
-    // Print marking results BEFORE sweep
-    /* printf("Marked objects:\n"); */
-    object_t *obj = all_objects;
-    while (obj) {
-        /* printf("  Object %p: marked=%d\n", (void*)obj, obj->marked); */
-        obj = obj->next_object;
+// The owner bump-allocates without gc_lock, so it and the sweeper take turns on a
+// chunk through busy. An allocation holds it from the bump until the object is
+// published, which covers the choice of its colour; the sweeper holds it for the
+// whole chunk. Both hold it only briefly and never block while holding it.
+static inline void chunk_lock(gc_chunk_t *chunk) {
+    while (__atomic_exchange_n(&chunk->busy, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&chunk->busy, __ATOMIC_RELAXED)) {
+            sched_yield();
+        }
     }
+}
 
-    sweep_phase();
+static inline void chunk_unlock(gc_chunk_t *chunk) {
+    __atomic_store_n(&chunk->busy, 0, __ATOMIC_RELEASE);
 }
 
-// Write barrier for incremental collection
-void gc_write_barrier(object_t *parent, size_t slot, object_t *child) {
-    if (!parent || slot >= parent->child_count) return;
+// Starts and marks are cleared by the sweeper and set by the collector and the
+// allocating thread, so the words are updated atomically.
+static inline void chunk_set_start(gc_chunk_t *chunk, object_t *obj) {
+    size_t g = chunk_granule(chunk, obj);
+    __atomic_fetch_or(&chunk->starts[g / 64], 1ULL << (g % 64), __ATOMIC_RELEASE);
+}
+
+static inline void chunk_set_mark(gc_chunk_t *chunk, object_t *obj) {
+    size_t g = chunk_granule(chunk, obj);
+    __atomic_fetch_or(&chunk->marks[g / 64], 1ULL << (g % 64), __ATOMIC_RELAXED);
+}
+
+// Finds the live object whose extent covers ptr by searching the starts bitmap
+// backwards from ptr's granule - at most TLAB_GRANULES / 64 words.
+static object_t *chunk_object_containing(gc_chunk_t *chunk, const void *ptr) {
+    if ((const uint8_t *)ptr < chunk->data || (const uint8_t *)ptr >= chunk->top) return NULL;
+    if (chunk->large) {
+        return (chunk->starts[0] & 1) ? (object_t *)chunk->data : NULL;
+    }
+
+    size_t g = chunk_granule(chunk, ptr);
+    size_t word = g / 64;
+    uint64_t bits = chunk->starts[word] & (~0ULL >> (63 - g % 64));
+    while (!bits) {
+        if (word == 0) return NULL;
+        bits = chunk->starts[--word];
+    }
+
+    size_t start = word * 64 + 63 - __builtin_clzll(bits);
+    object_t *obj = (object_t *)(chunk->data + start * TLAB_GRANULE);
+    return (const uint8_t *)ptr < (uint8_t *)obj + tlab_align(obj_extent(obj)) ? obj : NULL;
+}
 
-    parent->children[slot] = child;
+// Sets up an empty chunk ending at limit and counts it against the heap. It is made
+// for an allocation, so it starts out busy until that object is published.
+static void chunk_format(gc_chunk_t *chunk, uint8_t *limit, int large, int mapped) {
+    chunk->magic = GC_CHUNK_MAGIC;
+    chunk->top = chunk->data;
+    chunk->limit = limit;
+    chunk->owned = !large;
+    chunk->busy = 1;
+    chunk->large = (uint8_t)large;
+    chunk->mapped = (uint8_t)mapped;
+    // A chunk made while sweeping counts as already swept: its objects are born white
+    chunk->swept = heap->gc_phase == GC_PHASE_SWEEP ? heap->gc_epoch : heap->gc_epoch - 1;
+    chunk->free_bytes = 0;
+    chunk->heap = heap;
+    chunk->promoted = 0;
+    chunk->region = NULL;
+    chunk->region_next = NULL;
+    memset(chunk->starts, 0, sizeof(chunk->starts));
+    memset(chunk->marks, 0, sizeof(chunk->marks));
 
-    // If collection is in progress and parent is marked but child is not,
-    // mark the child to maintain correctness
-    if (gc_collection_in_progress && parent->marked && child && !child->marked) {
-        pthread_mutex_lock(&gc_lock);
-        printf("-> parent marked? %d, child marked? %d\n", parent->marked, child ? child->marked : -1);
-        mark_object(child);
-        pthread_mutex_unlock(&gc_lock);
+    uintptr_t lo = __atomic_load_n(&gc_heap_lo, __ATOMIC_RELAXED);
+    while ((uintptr_t)chunk < lo &&
+           !__atomic_compare_exchange_n(&gc_heap_lo, &lo, (uintptr_t)chunk, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    uintptr_t hi = __atomic_load_n(&gc_heap_hi, __ATOMIC_RELAXED);
+    while ((uintptr_t)limit > hi &&
+           !__atomic_compare_exchange_n(&gc_heap_hi, &hi, (uintptr_t)limit, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
     }
+    __atomic_fetch_add(&heap->gc_bytes_allocated, (size_t)(chunk->limit - chunk->data), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&heap->gc_heap_bytes, (size_t)(chunk->limit - (uint8_t *)chunk), __ATOMIC_RELAXED);
 }
 
-int findObj(void *ptr) {
-    object_t *curr = all_objects;
-    while (curr) {
-        if (curr == ptr) return 1;
-        curr = curr->next_object;
+static gc_chunk_t *chunk_new(size_t request, int large) {
+    gc_chunk_t *chunk = tb_allocator_malloc(heap->allocator, request);
+    if (!chunk) return NULL;
+
+    chunk_format(chunk, (uint8_t *)chunk + tb_usable_size(chunk), large, 0);
+    return chunk;
+}
+
+// Colour for an object born in chunk. While marking everything is born black, as
+// it is in chunks the sweeper has yet to reach; those marks are cleared when the
+// chunk is swept. Anywhere else a black object would survive into the next cycle
+// already marked, and the marker would never trace its children.
+static inline uint64_t birth_color(const gc_chunk_t *chunk) {
+    if (heap->gc_phase == GC_PHASE_MARK || (heap->gc_phase == GC_PHASE_SWEEP && chunk->swept != heap->gc_epoch)) {
+        return GC_MARKED | GC_SCANNED;
     }
     return 0;
 }
 
+static void pace_allocation(void);
+static void auto_collect(void);
+
+// Collector work owed to the mutator is paid on the allocation slow paths, before
+// the new chunk exists and while the caller holds no GC lock. A pending stop is
+// honoured first.
+static inline void allocation_safepoint(void) {
+    safepoint_poll();
+    pace_allocation();
+    gc_scheduler_poll();
+    auto_collect();
+}
+
+// Retires the thread's current chunk and takes a fresh one from the allocator.
+// Only this path, once per chunk, touches gc_lock.
+static object_t *tlab_refill(gc_thread_t *thread, size_t aligned) {
+    allocation_safepoint();
+
+    // Leave room for the allocator's block header so the chunk fills exactly one block
+    gc_chunk_t *chunk = chunk_new(TLAB_CHUNK_SIZE - 2 * ALIGNMENT, 0);
+    if (!chunk) return NULL;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    if (thread->tlab) {
+        thread->tlab->owned = 0;
+    }
+    thread->tlab = chunk;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    object_t *obj = (object_t *)chunk->top;
+    chunk->top += aligned;
+    return obj;
+}
+
+// Returns with the chunk busy; alloc_object publishes the object.
+static object_t *tlab_alloc(size_t object_size) {
+    gc_thread_t *thread = current_thread;
+    if (!thread && !(thread = gc_thread_register())) return NULL;
+
+    size_t aligned = tlab_align(object_size);
+    gc_chunk_t *chunk = thread->tlab;
+    if (chunk) {
+        chunk_lock(chunk);
+        if ((size_t)(chunk->limit - chunk->top) >= aligned) {
+            object_t *obj = (object_t *)chunk->top;
+            chunk->top += aligned;
+            return obj;
+        }
+        chunk_unlock(chunk);
+    }
+    return tlab_refill(thread, aligned);
+}
+
+/* ========================= REGIONS ========================= */
+
+static gc_chunk_t *next_chunk(gc_chunk_t *prev);
+
+// A thread finds its region chunks by address through an open-addressed table
+// keyed by TLAB_CHUNK_SIZE window: a chunk is entered under every window it
+// overlaps, so a lookup probes one window and checks each candidate's extent.
+static inline size_t region_slot(uintptr_t window, size_t capacity) {
+    return (size_t)((window * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+static void region_table_insert(gc_thread_t *thread, gc_chunk_t *chunk) {
+    size_t mask = thread->region_table_capacity - 1;
+    uintptr_t first = (uintptr_t)chunk / TLAB_CHUNK_SIZE;
+    uintptr_t last = ((uintptr_t)chunk->limit - 1) / TLAB_CHUNK_SIZE;
+    for (uintptr_t window = first; window <= last; window++) {
+        size_t i = region_slot(window, thread->region_table_capacity);
+        while (thread->region_table[i]) {
+            i = (i + 1) & mask;
+        }
+        thread->region_table[i] = chunk;
+        thread->region_table_count++;
+    }
+}
+
+// Refills the table from the thread's regions, leaving out promoted chunks, after
+// growing it to hold at least reserve more entries. Returns 0 if out of memory.
+static int region_table_rebuild(gc_thread_t *thread, size_t reserve) {
+    size_t needed = reserve;
+    for (gc_region_t *region = thread->region; region; region = region->outer) {
+        for (gc_chunk_t *chunk = region->chunks; chunk; chunk = chunk->region_next) {
+            if (!chunk->promoted) needed += 2;
+        }
+    }
+
+    // Keep the table at most half full so probes stay short
+    size_t capacity = thread->region_table_capacity;
+    if (needed * 2 > capacity) {
+        capacity = capacity ? capacity : 64;
+        while (needed * 2 > capacity) {
+            capacity *= 2;
+        }
+        gc_chunk_t **table = calloc(capacity, sizeof(gc_chunk_t *));
+        if (!table) return 0;
+        free(thread->region_table);
+        thread->region_table = table;
+        thread->region_table_capacity = capacity;
+    } else if (thread->region_table) {
+        memset(thread->region_table, 0, capacity * sizeof(gc_chunk_t *));
+    }
+
+    thread->region_table_count = 0;
+    for (gc_region_t *region = thread->region; region; region = region->outer) {
+        for (gc_chunk_t *chunk = region->chunks; chunk; chunk = chunk->region_next) {
+            if (!chunk->promoted) region_table_insert(thread, chunk);
+        }
+    }
+    return 1;
+}
+
+// The chunk of one of the thread's open regions holding obj, or NULL if obj is in
+// the heap or a promoted chunk.
+static gc_chunk_t *region_chunk_of(gc_thread_t *thread, const object_t *obj) {
+    if (!thread->region_table_count) return NULL;
+
+    size_t mask = thread->region_table_capacity - 1;
+    uintptr_t window = (uintptr_t)obj / TLAB_CHUNK_SIZE;
+    for (size_t i = region_slot(window, thread->region_table_capacity); thread->region_table[i]; i = (i + 1) & mask) {
+        gc_chunk_t *chunk = thread->region_table[i];
+        if ((const uint8_t *)obj >= chunk->data && (const uint8_t *)obj < chunk->top) {
+            return chunk->region && !chunk->promoted ? chunk : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void promote_chunk(gc_chunk_t *chunk) {
+    chunk->promoted = 1;
+    if (chunk->region->current == chunk) {
+        chunk->region->current = NULL;
+    }
+    chunk->promote_next = promote_list;
+    promote_list = chunk;
+    __atomic_fetch_add(&heap->gc_stats.region_bytes_promoted, (size_t)(chunk->limit - (uint8_t *)chunk),
+                       __ATOMIC_RELAXED);
+}
+
+static void promote_slot(object_t **slot) {
+    gc_chunk_t *chunk = *slot ? region_chunk_of(current_thread, *slot) : NULL;
+    if (chunk) promote_chunk(chunk);
+}
+
+// Hands chunk, and every region chunk reachable from an object in it, to the heap
+// when its region ends. Promotion is by whole chunk, so no object needs to be
+// visited twice: once a chunk is promoted, all of its objects' children are.
+static void region_escape(gc_chunk_t *chunk) {
+    promote_chunk(chunk);
+    while (promote_list) {
+        chunk = promote_list;
+        promote_list = chunk->promote_next;
+        for (size_t w = 0; w < TLAB_GRANULES / 64; w++) {
+            for (uint64_t bits = chunk->starts[w]; bits; bits &= bits - 1) {
+                object_t *obj = (object_t *)(chunk->data + (w * 64 + (size_t)__builtin_ctzll(bits)) * TLAB_GRANULE);
+                scan_object(obj, promote_slot);
+            }
+        }
+    }
+}
+
+// Called by the barrier while a region is open. child escapes unless parent lives
+// in a region at least as deeply nested, which ends no later than child's.
+void gc_region_store(object_t *parent, object_t *child) {
+    gc_thread_t *thread = current_thread;
+    if (!thread || !thread->region) return;
+
+    // Usually the parent was just allocated in the innermost region, the deepest
+    gc_chunk_t *current = thread->region->current;
+    if (current && (uint8_t *)parent >= current->data && (uint8_t *)parent < current->top) return;
+
+    gc_chunk_t *chunk = region_chunk_of(thread, child);
+    if (!chunk) return;
+    gc_chunk_t *holder = region_chunk_of(thread, parent);
+    if (holder && holder->region->depth >= chunk->region->depth) return;
+    region_escape(chunk);
+}
+
+static void region_escape_object(object_t *obj) {
+    gc_thread_t *thread = current_thread;
+    gc_chunk_t *chunk = thread && obj ? region_chunk_of(thread, obj) : NULL;
+    if (chunk) region_escape(chunk);
+}
+
+// Returns with the chunk busy, as tlab_alloc does.
+static object_t *region_alloc(gc_thread_t *thread, size_t object_size) {
+    gc_region_t *region = thread->region;
+    size_t aligned = tlab_align(object_size);
+    gc_chunk_t *chunk = region->current;
+    if (chunk) {
+        chunk_lock(chunk);
+        if ((size_t)(chunk->limit - chunk->top) < aligned) {
+            chunk_unlock(chunk);
+            chunk = NULL;
+        }
+    }
+    if (!chunk) {
+        allocation_safepoint();
+        if ((thread->region_table_count + 2) * 2 > thread->region_table_capacity &&
+            !region_table_rebuild(thread, 2)) {
+            return NULL;
+        }
+        chunk = chunk_new(TLAB_CHUNK_SIZE - 2 * ALIGNMENT, 0);
+        if (!chunk) return NULL;
+
+        pthread_mutex_lock(&heap->gc_lock);
+        chunk->region = region;
+        chunk->region_next = region->chunks;
+        region->chunks = chunk;
+        pthread_mutex_unlock(&heap->gc_lock);
+        region_table_insert(thread, chunk);
+        region->current = chunk;
+    }
+
+    object_t *obj = (object_t *)chunk->top;
+    chunk->top += aligned;
+    return obj;
+}
+
+// Gives every chunk of the thread's regions to the heap, leaving the regions open
+// but empty. Called with gc_lock held.
+static void regions_hand_over(gc_thread_t *thread) {
+    for (gc_region_t *region = thread->region; region; region = region->outer) {
+        for (gc_chunk_t *chunk = region->chunks; chunk; chunk = chunk->region_next) {
+            chunk->region = NULL;
+            chunk->owned = 0;
+        }
+        region->chunks = region->current = NULL;
+    }
+    if (thread->region_table) {
+        memset(thread->region_table, 0, thread->region_table_capacity * sizeof(gc_chunk_t *));
+    }
+    thread->region_table_count = 0;
+}
+
+int gc_region_begin(void) {
+    gc_thread_t *thread = current_thread;
+    if (!thread && !(thread = gc_thread_register())) return 0;
+
+    gc_region_t *region = calloc(1, sizeof(gc_region_t));
+    if (!region) return 0;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    region->outer = thread->region;
+    region->depth = gc_region_depth + 1;
+    thread->region = region;
+    pthread_mutex_unlock(&heap->gc_lock);
+    gc_region_depth = region->depth;
+    return 1;
+}
 
-#endif // TB_GC
+void gc_region_end(void) {
+    gc_thread_t *thread = current_thread;
+    gc_region_t *region = thread ? thread->region : NULL;
+    if (!region) return;
+
+    // Whatever the roots still hold outlives the region
+    size_t depth = thread->shadow_depth;
+    shadow_chunk_t *shadow = thread->shadow_bottom;
+    for (size_t i = 0; i < depth; i++) {
+        if (i && i % SHADOW_CHUNK_SLOTS == 0) {
+            shadow = shadow->next;
+        }
+        region_escape_object(*shadow->slots[i % SHADOW_CHUNK_SLOTS]);
+    }
+
+    pthread_mutex_lock(&heap->gc_lock);
+    for (size_t i = 0; i < heap->root_count; i++) {
+        region_escape_object(heap->root_set[i]);
+    }
+
+    // While marking, the mark stack and barrier buffers may still refer to the
+    // region's objects, so its chunks go to the heap to be swept like any other
+    int keep = heap->gc_phase == GC_PHASE_MARK;
+    gc_chunk_t *chunk = region->chunks;
+    while (chunk) {
+        gc_chunk_t *next = chunk->region_next;
+        chunk->region = NULL;
+        if (chunk->promoted || keep) {
+            chunk->owned = 0;
+        } else {
+            size_t bytes = (size_t)(chunk->limit - (uint8_t *)chunk);
+            if (heap->sweep_cursor == chunk) {
+                heap->sweep_cursor = next_chunk(chunk);
+            }
+            __atomic_fetch_sub(&heap->gc_heap_bytes, bytes, __ATOMIC_RELAXED);
+            heap->gc_stats.region_bytes_released += bytes;
+            tb_free(chunk);
+        }
+        chunk = next;
+    }
+    thread->region = region->outer;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    gc_region_depth = region->depth - 1;
+    free(region);
+    region_table_rebuild(thread, 0);
+}
+
+/* ========================= LARGE-OBJECT SPACE ========================= */
+
+static inline los_mapping_t *chunk_mapping(gc_chunk_t *chunk) {
+    return (los_mapping_t *)chunk - 1;
+}
+
+// Unmaps queued mappings one at a time, crediting each to the heap that last used
+// it. The heap of the mapping in flight is kept in los_unmapping_heap, where
+// gc_heap_destroy can clear it, since the mapping itself is gone by then.
+static void *los_unmapper_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&los_lock);
+    for (;;) {
+        while (!los_unmap_queue) {
+            pthread_cond_wait(&los_cond, &los_lock);
+        }
+        los_mapping_t *m = los_unmap_queue;
+        los_unmap_queue = m->next;
+        size_t bytes = m->bytes;
+        los_unmapping_heap = m->heap;
+        pthread_mutex_unlock(&los_lock);
+
+        munmap(m, bytes);
+
+        pthread_mutex_lock(&los_lock);
+        if (los_unmapping_heap) {
+            __atomic_fetch_add(&los_unmapping_heap->gc_stats.large_bytes_unmapped, bytes, __ATOMIC_RELAXED);
+            los_unmapping_heap = NULL;
+        }
+    }
+    return NULL;
+}
+
+// Hands m to the unmapper thread, starting it the first time. If the thread cannot
+// be started the mapping is unmapped on the spot. Called with los_lock held.
+static void los_unmap_later(los_mapping_t *m) {
+    if (!los_unmapper) {
+        pthread_t thread;
+        los_unmapper = pthread_create(&thread, NULL, los_unmapper_main, NULL) == 0 ? 1 : -1;
+        if (los_unmapper > 0) pthread_detach(thread);
+    }
+    if (los_unmapper < 0) {
+        size_t bytes = m->bytes;
+        gc_heap_t *owner = m->heap;
+        munmap(m, bytes);
+        if (owner) __atomic_fetch_add(&owner->gc_stats.large_bytes_unmapped, bytes, __ATOMIC_RELAXED);
+        return;
+    }
+    m->next = los_unmap_queue;
+    los_unmap_queue = m;
+    pthread_cond_signal(&los_cond);
+}
+
+// Number of mappings in los_index starting at or below addr. Called with los_lock held.
+static size_t los_index_upper(uintptr_t addr) {
+    size_t lo = 0, hi = los_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((uintptr_t)los_index[mid] <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Links a formatted mapping into the space. Returns 0 if the index could not grow.
+static int los_publish(los_mapping_t *m) {
+    pthread_mutex_lock(&los_lock);
+    if (los_count == los_index_capacity) {
+        size_t capacity = los_index_capacity ? los_index_capacity * 2 : 64;
+        los_mapping_t **index = realloc(los_index, sizeof(los_mapping_t *) * capacity);
+        if (!index) {
+            pthread_mutex_unlock(&los_lock);
+            return 0;
+        }
+        los_index = index;
+        los_index_capacity = capacity;
+    }
+    size_t pos = los_index_upper((uintptr_t)m);
+    memmove(&los_index[pos + 1], &los_index[pos], sizeof(los_mapping_t *) * (los_count - pos));
+    los_index[pos] = m;
+    __atomic_store_n(&los_count, los_count + 1, __ATOMIC_RELAXED);
+
+    m->prev = NULL;
+    m->next = heap->los_objects;
+    if (heap->los_objects) heap->los_objects->prev = m;
+    heap->los_objects = m;
+    pthread_mutex_unlock(&los_lock);
+    return 1;
+}
+
+// Puts m on the cache, or queues it for unmapping if the cache is full. Called with
+// los_lock held.
+static void los_retire(los_mapping_t *m) {
+    if (los_cache_bytes + m->bytes > GC_LOS_CACHE_BYTES) {
+        los_unmap_later(m);
+        return;
+    }
+    m->cached = __atomic_load_n(&gc_cycles, __ATOMIC_RELAXED);
+    m->prev = NULL;
+    m->next = los_cache;
+    if (los_cache) los_cache->prev = m;
+    los_cache = m;
+    los_cache_bytes += m->bytes;
+}
+
+// Gives an object of aligned bytes a chunk in a mapping of its own. A cached mapping
+// is reused if one fits without wasting more than a quarter of the request;
+// otherwise the object costs one mmap.
+static gc_chunk_t *los_chunk_new(size_t aligned) {
+    size_t card_words = aligned / sizeof(object_t *) / GC_SCAN_CHUNK / 64 + 1;
+    size_t bytes = (sizeof(los_mapping_t) + sizeof(gc_chunk_t) + aligned + card_words * sizeof(uint64_t) +
+                    GC_LOS_PAGE - 1) & ~(size_t)(GC_LOS_PAGE - 1);
+
+    pthread_mutex_lock(&los_lock);
+    los_mapping_t *m = NULL;
+    for (los_mapping_t *c = los_cache; c; c = c->next) {
+        if (c->bytes >= bytes && c->bytes - bytes <= bytes / 4 && (!m || c->bytes < m->bytes)) {
+            m = c;
+        }
+    }
+    if (m) {
+        if (m->prev) m->prev->next = m->next;
+        else los_cache = m->next;
+        if (m->next) m->next->prev = m->prev;
+        los_cache_bytes -= m->bytes;
+        __atomic_fetch_add(&heap->gc_stats.large_cache_hits, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&los_lock);
+
+    if (!m) {
+        m = tb_request_memory(bytes);
+        if (!m) return NULL;
+        m->bytes = bytes;
+    }
+
+    // Format before publishing: a reused mapping still holds its last chunk
+    gc_chunk_t *chunk = (gc_chunk_t *)(m + 1);
+    chunk_format(chunk, (uint8_t *)m + m->bytes, 1, 1);
+    m->heap = heap;
+    m->queued = 0;
+    m->cards = (uint64_t *)(chunk->data + aligned);
+    memset(m->cards, 0, card_words * sizeof(uint64_t));
+    if (!los_publish(m)) {
+        __atomic_fetch_sub(&heap->gc_heap_bytes, (size_t)(chunk->limit - (uint8_t *)chunk), __ATOMIC_RELAXED);
+        pthread_mutex_lock(&los_lock);
+        los_retire(m);
+        pthread_mutex_unlock(&los_lock);
+        return NULL;
+    }
+    __atomic_fetch_add(&heap->gc_stats.large_objects, 1, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+// Takes the mapping of a swept, empty chunk out of the space and retires it.
+static void los_chunk_free(gc_chunk_t *chunk) {
+    los_mapping_t *m = chunk_mapping(chunk);
+    pthread_mutex_lock(&los_lock);
+    if (m->prev) m->prev->next = m->next;
+    else heap->los_objects = m->next;
+    if (m->next) m->next->prev = m->prev;
+
+    size_t pos = los_index_upper((uintptr_t)m) - 1;
+    memmove(&los_index[pos], &los_index[pos + 1], sizeof(los_mapping_t *) * (los_count - pos - 1));
+    __atomic_store_n(&los_count, los_count - 1, __ATOMIC_RELAXED);
+
+    los_retire(m);
+    pthread_mutex_unlock(&los_lock);
+}
+
+// Queues cached mappings that entered the cache before epoch for unmapping.
+static void los_trim_cache(uint32_t epoch) {
+    pthread_mutex_lock(&los_lock);
+    los_mapping_t **link = &los_cache;
+    while (*link) {
+        los_mapping_t *m = *link;
+        if ((int32_t)(m->cached - epoch) < 0) {
+            *link = m->next;
+            if (m->next) m->next->prev = m->prev;
+            los_cache_bytes -= m->bytes;
+            los_unmap_later(m);
+        } else {
+            link = &m->next;
+        }
+    }
+    pthread_mutex_unlock(&los_lock);
+}
+
+void gc_release_large_cache(void) {
+    los_trim_cache(__atomic_load_n(&gc_cycles, __ATOMIC_RELAXED) + 1);
+}
+
+// The chunk of the large object whose mapping covers ptr, or NULL.
+static gc_chunk_t *los_chunk_of(const void *ptr) {
+    if (!__atomic_load_n(&los_count, __ATOMIC_RELAXED)) return NULL;
+
+    gc_chunk_t *chunk = NULL;
+    pthread_mutex_lock(&los_lock);
+    size_t pos = los_index_upper((uintptr_t)ptr);
+    if (pos && (uintptr_t)ptr < (uintptr_t)los_index[pos - 1] + los_index[pos - 1]->bytes) {
+        chunk = (gc_chunk_t *)(los_index[pos - 1] + 1);
+    }
+    pthread_mutex_unlock(&los_lock);
+    return chunk;
+}
+
+// The mapping of obj if it is an array big enough for card marking, else NULL. Only
+// the large-object space holds objects of GC_LOS_THRESHOLD bytes in mark-sweep mode.
+static los_mapping_t *card_marked_mapping(object_t *obj) {
+    if ((obj->header & (GC_TYPED | GC_WEAK)) || obj_child_count(obj) <= GC_SCAN_CHUNK ||
+        tlab_align(obj_extent(obj)) < GC_LOS_THRESHOLD || heap->gc_mode != GC_MODE_MARK_SWEEP) {
+        return NULL;
+    }
+    gc_chunk_t *chunk = (gc_chunk_t *)((uint8_t *)obj - offsetof(gc_chunk_t, data));
+    return chunk->mapped ? chunk_mapping(chunk) : NULL;
+}
+
+static object_t *large_alloc(size_t object_size) {
+    allocation_safepoint();
+
+    size_t aligned = tlab_align(object_size);
+    gc_chunk_t *chunk = aligned >= GC_LOS_THRESHOLD ? los_chunk_new(aligned)
+                                                    : chunk_new(sizeof(gc_chunk_t) + aligned, 1);
+    if (!chunk) return NULL;
+
+    object_t *obj = (object_t *)chunk->data;
+    chunk->top += aligned;
+    return obj;
+}
+
+// Bumps the active semispace, this thread's innermost region if scoped, or its TLAB,
+// or gives the object a chunk of its own, and reports the colour the object must be
+// born with. An object born black is entered in its chunk's marks straight away. The
+// chunk, if any, is returned busy in *chunk_out, for the object to be published in.
+static object_t *allocate(size_t object_size, int scoped, uint64_t *color, gc_chunk_t **chunk_out) {
+    *chunk_out = NULL;
+    if (heap->gc_mode == GC_MODE_SEMISPACE) {
+        return semispace_alloc(object_size);
+    }
+
+    gc_chunk_t *chunk;
+    object_t *obj;
+    gc_thread_t *thread = current_thread;
+    if (thread && thread->parked) thread_unpark(thread);
+    if (object_size <= TLAB_MAX_OBJECT && scoped && thread && thread->region) {
+        obj = region_alloc(thread, object_size);
+        chunk = obj ? thread->region->current : NULL;
+    } else if (object_size <= TLAB_MAX_OBJECT) {
+        obj = tlab_alloc(object_size);
+        chunk = obj ? current_thread->tlab : NULL;
+    } else {
+        obj = large_alloc(object_size);
+        chunk = obj ? (gc_chunk_t *)((uint8_t *)obj - offsetof(gc_chunk_t, data)) : NULL;
+    }
+    if (obj) {
+        *color = birth_color(chunk);
+        if (*color & GC_MARKED) chunk_set_mark(chunk, obj);
+        *chunk_out = chunk;
+    }
+    return obj;
+}
+
+static int heap_may_grow(void) {
+    return heap->gc_mode == GC_MODE_MARK_SWEEP && tb_allocator_capacity(heap->allocator) + HEAP_SIZE <= heap->heap_policy.max_heap_bytes;
+}
+
+// The allocator is out of memory: collect everything unreachable and try again,
+// then grow the heap one arena at a time while the policy allows it.
+static void collect_automatic(void);
+
+static object_t *collect_and_retry(size_t object_size, int scoped, uint64_t *color, gc_chunk_t **chunk) {
+    collect_automatic();
+    __atomic_fetch_add(&heap->gc_stats.failure_collections, 1, __ATOMIC_RELAXED);
+
+    object_t *obj = allocate(object_size, scoped, color, chunk);
+    while (!obj && heap_may_grow() && tb_allocator_grow(heap->allocator)) {
+        __atomic_fetch_add(&heap->gc_stats.heap_grows, 1, __ATOMIC_RELAXED);
+        obj = allocate(object_size, scoped, color, chunk);
+    }
+    return obj;
+}
+
+// Allocates and formats an object. count_field is the child count, or the type id
+// when flags include GC_TYPED. Only scoped objects may go in a region.
+static object_t *alloc_object(size_t size, size_t count_field, uint64_t flags, int scoped) {
+    if (count_field > GC_COUNT_MAX || size / GC_GRANULE >= (1ULL << 32)) return NULL;
+
+    // Calculate total size needed
+    size_t child_slots = (flags & GC_TYPED) ? 0 : count_field;
+    size_t object_size = object_total_size(size, child_slots);
+
+    uint64_t color = 0;
+    gc_chunk_t *chunk;
+    object_t *obj = allocate(object_size, scoped, &color, &chunk);
+    if (!obj && heap->heap_policy.auto_collect) {
+        obj = collect_and_retry(object_size, scoped, &color, &chunk);
+    }
+    if (!obj) return NULL;
+
+    // Initialize object fields
+    uint64_t granules = (size + GC_GRANULE - 1) / GC_GRANULE;
+    obj->header = (granules << GC_SIZE_SHIFT) |
+                  ((uint64_t)count_field << GC_COUNT_SHIFT) | flags | color;
+
+    // Clear the children array, or for typed objects the payload holding their pointers
+    if (flags & GC_TYPED) {
+        memset(obj_data(obj), 0, obj_size(obj));
+    } else {
+        memset(obj_children(obj), 0, sizeof(object_t *) * child_slots);
+    }
+
+    // Only a formatted object, with its mark if any, may be seen by the sweeper
+    if (chunk) {
+        chunk_set_start(chunk, obj);
+        chunk_unlock(chunk);
+    }
+    return obj;
+}
+
+void *gc_alloc(size_t size, size_t child_slots) {
+    object_t *obj = alloc_object(size, child_slots, 0, 1);
+
+    // Return pointer to user data area (right after the header)
+    return obj ? obj_data(obj) : NULL;
+}
+
+/* ========================= TYPE DESCRIPTORS ========================= */
+
+static int compare_offsets(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Enters type in the table, which takes over its offsets.
+static gc_type_id_t add_type(gc_type_t type) {
+    pthread_mutex_lock(&type_lock);
+    gc_type_id_t id = GC_TYPE_INVALID;
+    if (gc_type_count < GC_MAX_TYPES) {
+        id = (gc_type_id_t)gc_type_count;
+        gc_types[gc_type_count++] = type;
+    }
+    pthread_mutex_unlock(&type_lock);
+
+    if (id == GC_TYPE_INVALID) free(type.offsets);
+    return id;
+}
+
+gc_type_id_t gc_register_type(size_t size, const size_t *ptr_offsets, size_t ptr_count) {
+    for (size_t i = 0; i < ptr_count; i++) {
+        if (ptr_offsets[i] % sizeof(object_t *) || ptr_offsets[i] + sizeof(object_t *) > size) {
+            return GC_TYPE_INVALID;
+        }
+    }
+
+    size_t *offsets = NULL;
+    if (ptr_count) {
+        offsets = malloc(sizeof(size_t) * ptr_count);
+        if (!offsets) return GC_TYPE_INVALID;
+        memcpy(offsets, ptr_offsets, sizeof(size_t) * ptr_count);
+        qsort(offsets, ptr_count, sizeof(size_t), compare_offsets);
+    }
+
+    gc_type_t type = { .size = size, .ptr_count = ptr_count, .offsets = offsets };
+    if (!ptr_count) {
+        type.kind = GC_SCAN_NONE;
+    } else if (offsets[ptr_count - 1] / sizeof(object_t *) < 64) {
+        type.kind = GC_SCAN_BITMAP;
+        for (size_t i = 0; i < ptr_count; i++) {
+            type.bitmap |= 1ULL << (offsets[i] / sizeof(object_t *));
+        }
+    } else {
+        type.kind = GC_SCAN_OFFSETS;
+    }
+    return add_type(type);
+}
+
+gc_type_id_t gc_register_type_bitmap(size_t size, uint64_t ptr_bitmap) {
+    size_t ptr_count = (size_t)__builtin_popcountll(ptr_bitmap);
+    if (ptr_bitmap && (64 - (size_t)__builtin_clzll(ptr_bitmap)) * sizeof(object_t *) > size) {
+        return GC_TYPE_INVALID;
+    }
+
+    // The offsets still address slots by index; bit order is already ascending
+    size_t *offsets = NULL;
+    if (ptr_count) {
+        offsets = malloc(sizeof(size_t) * ptr_count);
+        if (!offsets) return GC_TYPE_INVALID;
+        size_t i = 0;
+        for (uint64_t bits = ptr_bitmap; bits; bits &= bits - 1) {
+            offsets[i++] = (size_t)__builtin_ctzll(bits) * sizeof(object_t *);
+        }
+    }
+
+    gc_type_t type = { .size = size, .kind = ptr_count ? GC_SCAN_BITMAP : GC_SCAN_NONE, .bitmap = ptr_bitmap,
+                       .ptr_count = ptr_count, .offsets = offsets };
+    return add_type(type);
+}
+
+void *gc_alloc_typed(gc_type_id_t type_id) {
+    if (type_id >= gc_type_count) return NULL;
+
+    object_t *obj = alloc_object(gc_types[type_id].size, type_id, GC_TYPED, 1);
+    return obj ? obj_data(obj) : NULL;
+}
+
+// Resolves ptr - possibly pointing into the middle of an object - to the live
+// object containing it, using the allocator's block lookup and the chunk bitmap.
+// Stores the object's chunk in *chunk_out if that is not NULL.
+static object_t *object_containing(const void *ptr, gc_chunk_t **chunk_out) {
+    void *block = tb_block_of(ptr);
+    if (!block) block = los_chunk_of(ptr);
+    if (!block) return NULL;
+
+    gc_chunk_t *chunk = block;
+    if (chunk->magic != GC_CHUNK_MAGIC) return NULL;
+    if (chunk_out) *chunk_out = chunk;
+    return chunk_object_containing(chunk, ptr);
+}
+
+// Walks allocator blocks in address order, returning the next one that is a GC chunk,
+// then the large-object space newest first.
+static gc_chunk_t *next_chunk(gc_chunk_t *prev) {
+    if (!prev || !prev->mapped) {
+        void *block = prev;
+        while ((block = tb_allocator_next_block(heap->allocator, block))) {
+            if (((gc_chunk_t *)block)->magic == GC_CHUNK_MAGIC) {
+                return block;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&los_lock);
+    los_mapping_t *m = prev && prev->mapped ? chunk_mapping(prev)->next : heap->los_objects;
+    pthread_mutex_unlock(&los_lock);
+    return m ? (gc_chunk_t *)(m + 1) : NULL;
+}
+
+static int is_tracked_object(object_t *obj) {
+    return object_containing(obj, NULL) == obj;
+}
+
+// Calls visit on every live object, in address order within the buddy heap.
+static void walk_heap(void (*visit)(object_t *)) {
+    for (gc_chunk_t *chunk = next_chunk(NULL); chunk; chunk = next_chunk(chunk)) {
+        uint8_t *curr = chunk->data;
+        while (curr < chunk->top) {
+            object_t *obj = (object_t *)curr;
+            curr += tlab_align(obj_extent(obj));
+            if (!(obj->header & GC_FREE)) {
+                visit(obj);
+            }
+        }
+    }
+}
+
+// Pushes an item, taking a fresh segment from the pool when the current one is full.
+// If the pool is exhausted the item is dropped and 0 returned: its object stays
+// marked but unscanned, and finish_marking picks it up again with a heap rescan.
+static int push_mark_stack(object_t *obj, size_t start) {
+    if (!heap->mark_stack || heap->mark_stack->top == MARK_CHUNK_ENTRIES) {
+        mark_chunk_t *chunk = heap->mark_chunk_free;
+        if (!chunk) {
+            heap->mark_stack_overflowed = 1;
+            return 0;
+        }
+        heap->mark_chunk_free = chunk->prev;
+        chunk->prev = heap->mark_stack;
+        chunk->top = 0;
+        heap->mark_stack = chunk;
+    }
+    heap->mark_stack->entries[heap->mark_stack->top++] = (mark_item_t){ obj, start };
+    return 1;
+}
+
+static int pop_mark_stack(mark_item_t *item) {
+    if (!heap->mark_stack) return 0;
+
+    if (heap->mark_stack->top == 0) {
+        // Keep the last segment around; return emptied ones to the pool
+        if (!heap->mark_stack->prev) return 0;
+        mark_chunk_t *empty = heap->mark_stack;
+        heap->mark_stack = empty->prev;
+        empty->prev = heap->mark_chunk_free;
+        heap->mark_chunk_free = empty;
+    }
+    *item = heap->mark_stack->entries[--heap->mark_stack->top];
+    return 1;
+}
+
+static void mark_found(gc_chunk_t *chunk, object_t *obj) {
+    obj->header |= GC_MARKED;
+    chunk_set_mark(chunk, obj);
+    heap->gc_stats.objects_marked++;
+    heap->gc_stats.bytes_marked += obj_extent(obj);
+    push_mark_stack(obj, 0);
+}
+
+static void mark_object(object_t *obj) {
+    gc_chunk_t *chunk;
+    if (!obj || (obj->header & GC_MARKED) || object_containing(obj, &chunk) != obj) {
+        return;
+    };
+    mark_found(chunk, obj);
+}
+
+// Marks a child found while scanning. With prefetching on, the child's header is
+// prefetched and the child queued; it is only inspected once prefetch_distance more
+// children have been found, by which time the header has likely arrived in cache.
+static void mark_child(object_t *obj) {
+    if (!heap->prefetch_distance) {
+        mark_object(obj);
+        return;
+    }
+
+    __builtin_prefetch(obj, 1);
+    heap->prefetch_fifo[(heap->prefetch_head + heap->prefetch_count) & (GC_PREFETCH_MAX - 1)] = obj;
+    if (++heap->prefetch_count > heap->prefetch_distance) {
+        obj = heap->prefetch_fifo[heap->prefetch_head];
+        heap->prefetch_head = (heap->prefetch_head + 1) & (GC_PREFETCH_MAX - 1);
+        heap->prefetch_count--;
+        mark_object(obj);
+    }
+}
+
+static void mark_slot(object_t **slot) {
+    if (*slot) mark_child(*slot);
+}
+
+// Marks the children in n slots. Longer runs go through the vector filter, which
+// drops null and out-of-heap slots in bulk; whether a child is already marked is
+// left to mark_object, after the prefetch, since testing it here would take the
+// very cache misses the FIFO hides.
+static void mark_children(object_t **children, size_t n) {
+    if (n < GC_SIMD_MIN_SLOTS) {
+        for (size_t i = 0; i < n; i++) {
+            mark_slot(&children[i]);
+        }
+        return;
+    }
+
+    object_t *found[GC_SCAN_CHUNK];
+    uintptr_t lo = __atomic_load_n(&gc_heap_lo, __ATOMIC_RELAXED);
+    uintptr_t hi = __atomic_load_n(&gc_heap_hi, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < n; i += GC_SCAN_CHUNK) {
+        size_t count = tb_filter_slots((void *const *)children + i, n - i < GC_SCAN_CHUNK ? n - i : GC_SCAN_CHUNK,
+                                       lo, hi, (void **)found);
+        for (size_t j = 0; j < count; j++) {
+            mark_child(found[j]);
+        }
+    }
+}
+
+// Marks everything still waiting in the prefetch FIFO. Returns 0 if it was empty.
+static int flush_prefetch_fifo(void) {
+    if (!heap->prefetch_count) return 0;
+    while (heap->prefetch_count) {
+        object_t *obj = heap->prefetch_fifo[heap->prefetch_head];
+        heap->prefetch_head = (heap->prefetch_head + 1) & (GC_PREFETCH_MAX - 1);
+        heap->prefetch_count--;
+        mark_object(obj);
+    }
+    return 1;
+}
+
+static object_t *mark_root(object_t *obj) {
+    mark_object(obj);
+    return obj;
+}
+
+// Everything allocated in an open region is live until the region ends, wherever
+// the references to it are held. Promoted chunks are traced like the heap.
+static void mark_region_objects(void) {
+    for (gc_thread_t *thread = heap->gc_threads; thread; thread = thread->next) {
+        for (gc_region_t *region = thread->region; region; region = region->outer) {
+            for (gc_chunk_t *chunk = region->chunks; chunk; chunk = chunk->region_next) {
+                if (chunk->promoted) continue;
+                for (size_t w = 0; w < TLAB_GRANULES / 64; w++) {
+                    for (uint64_t bits = chunk->starts[w]; bits; bits &= bits - 1) {
+                        object_t *obj = (object_t *)(chunk->data + (w * 64 + (size_t)__builtin_ctzll(bits)) * TLAB_GRANULE);
+                        if (!(obj->header & GC_MARKED)) mark_found(chunk, obj);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static const gc_budget_t unlimited_budget = { UINT64_MAX, SIZE_MAX, 0 };
+
+static inline int past_deadline(const gc_budget_t *budget) {
+    return budget->deadline != UINT64_MAX && tb_now_ns() >= budget->deadline;
+}
+
+static inline int critical_event_pending(void) {
+    return heap->preemption.critical_event_pending && heap->preemption.critical_event_pending(heap->preemption.arg);
+}
+
+// Starts measuring the collector work before the first poll of a slice.
+static inline void preempt_begin(uint64_t now) {
+    heap->preempt_since_poll = 0;
+    heap->preempt_last_poll_ns = now;
+}
+
+// Polls the predicate and adapts the interval to the time the last one took: a gap
+// over half of max_wait_ns halves it, one under an eighth doubles it back towards
+// check_interval.
+static int preempt_check(gc_budget_t *budget) {
+    uint64_t now = tb_now_ns();
+    uint64_t gap = now - heap->preempt_last_poll_ns;
+    preempt_begin(now);
+    if (gap > heap->gc_stats.max_poll_gap_ns) heap->gc_stats.max_poll_gap_ns = gap;
+
+    if (gap > heap->preemption.max_wait_ns / 2) {
+        if (heap->preempt_interval > 1) heap->preempt_interval /= 2;
+    } else if (gap < heap->preemption.max_wait_ns / 8 && heap->preempt_interval < heap->preemption.check_interval) {
+        heap->preempt_interval *= 2;
+        if (heap->preempt_interval > heap->preemption.check_interval) heap->preempt_interval = heap->preemption.check_interval;
+    }
+
+    if (!critical_event_pending()) return 0;
+    budget->preempted = 1;
+    heap->gc_stats.preemptions++;
+    return 1;
+}
+
+// Takes done units of work from budget and reports whether the slice should stop.
+// The clock is only read every GC_SLICE_CHECK objects, the preemption predicate
+// every preempt_interval.
+static inline int charge_work(gc_budget_t *budget, size_t done, size_t *since_check) {
+    heap->cycle_work += done;
+    budget->work = budget->work > done ? budget->work - done : 0;
+    if (budget->work == 0) return 1;
+
+    if (heap->preemption.critical_event_pending) {
+        heap->preempt_since_poll += done;
+        if (heap->preempt_since_poll >= heap->preempt_interval && preempt_check(budget)) return 1;
+    }
+
+    *since_check += done;
+    if (*since_check < GC_SLICE_CHECK) return 0;
+    *since_check = 0;
+    return past_deadline(budget);
+}
+
+// Scans one item: a whole object, or the next chunk of a large children array. The
+// rest of the array is pushed back before its children so the stack stays shallow,
+// and the object only counts as scanned once its last chunk is done.
+static inline void scan_item(mark_item_t item) {
+    object_t *obj = item.obj;
+    if (obj->header & (GC_TYPED | GC_WEAK)) {
+        obj->header |= GC_SCANNED;
+        scan_object(obj, mark_slot);
+        return;
+    }
+    size_t count = obj_child_count(obj);
+    if (count <= GC_SCAN_CHUNK) {
+        obj->header |= GC_SCANNED;
+        mark_children(obj_children(obj), count);
+        return;
+    }
+
+    size_t start = item.start & ~MARK_CARD_ONLY;
+    size_t end = count - start > GC_SCAN_CHUNK ? start + GC_SCAN_CHUNK : count;
+    if (!(item.start & MARK_CARD_ONLY)) {
+        if (end == count) {
+            obj->header |= GC_SCANNED;
+        } else {
+            push_mark_stack(obj, end);
+        }
+    }
+    mark_children(obj_children(obj) + start, end - start);
+}
+
+// Scans gray objects until the stack and the prefetch FIFO are empty (returning 1)
+// or the budget runs out. The FIFO is always left empty, so no child is owed to the
+// marker between slices.
+static int drain_mark_stack_until(gc_budget_t *budget) {
+    mark_item_t item;
+    size_t since_check = 0;
+    do {
+        while (pop_mark_stack(&item)) {
+            scan_item(item);
+            if (charge_work(budget, 1, &since_check)) {
+                flush_prefetch_fifo();
+                return 0;
+            }
+        }
+    } while (flush_prefetch_fifo());
+    return 1;
+}
+
+// Drains to empty without polling for critical events, for the overflow rescan that
+// has to leave the stack empty behind every object it pushes.
+static void drain_mark_stack(void) {
+    mark_item_t item;
+    do {
+        while (pop_mark_stack(&item)) {
+            scan_item(item);
+            heap->cycle_work++;
+        }
+    } while (flush_prefetch_fifo());
+}
+
+/* ========================= CONSERVATIVE ROOTS ========================= */
+
+// Treats every aligned word in [lo, hi) as a potential pointer. Anything that lands
+// inside a live heap block - header, children or user data - keeps that object alive.
+static void scan_conservative_range(const void *lo, const void *hi) {
+    uintptr_t start = ((uintptr_t)lo + sizeof(void *) - 1) & ~(uintptr_t)(sizeof(void *) - 1);
+    for (void *const *word = (void *const *)start; (const void *)word < hi; word++) {
+        object_t *obj = object_containing(*word, NULL);
+        if (obj) {
+            mark_object(obj);
+        }
+    }
+}
+
+// Spills this thread's callee-saved registers into a jmp_buf in our own frame,
+// then scans from that frame up to the stack base.
+__attribute__((noinline)) static void scan_current_stack(gc_thread_t *thread) {
+    jmp_buf regs;
+    setjmp(regs);
+    scan_conservative_range(&regs, thread->stack_base);
+}
+
+// Scans the collecting thread live and every other registered thread, all parked,
+// from the state it recorded when it parked. Threads that never registered their
+// stack, or never reached a safepoint, contribute only their explicit roots.
+static void scan_thread_stacks(void) {
+    for (gc_thread_t *thread = heap->gc_threads; thread; thread = thread->next) {
+        if (!thread->stack_base) continue;
+
+        if (thread == current_thread) {
+            scan_current_stack(thread);
+        } else if (thread->saved_sp) {
+            scan_conservative_range(&thread->saved_regs, (uint8_t *)&thread->saved_regs + sizeof(jmp_buf));
+            scan_conservative_range(thread->saved_sp, thread->stack_base);
+        }
+    }
+}
+
+// Recovers from mark stack overflow by walking the heap for objects that were
+// marked but never scanned. Each pass drains before moving on, so repeated
+// overflows only cost another pass.
+static void rescan_object(object_t *obj) {
+    if ((obj->header & (GC_MARKED | GC_SCANNED)) == GC_MARKED) {
+        push_mark_stack(obj, 0);
+        drain_mark_stack();
+    }
+}
+
+static void rescan_overflowed(void) {
+    while (heap->mark_stack_overflowed) {
+        heap->mark_stack_overflowed = 0;
+        walk_heap(rescan_object);
+    }
+}
+
+/* ========================= WEAK REFERENCES AND EPHEMERONS ========================= */
+
+// Both collectors end tracing the same way, parameterized by survivor, which maps an
+// object to its post-collection address or NULL if it is dead, and retain, which
+// keeps an object alive: mark it, or copy it.
+
+static object_t *mark_survivor(object_t *obj) {
+    return obj && (obj->header & GC_MARKED) ? obj : NULL;
+}
+
+// Retains the value of every entry whose key survived, returning how many were
+// newly retained. The caller traces from them and calls again until this is 0.
+static size_t retain_ephemeron_values(object_t *(*survivor)(object_t *), void (*retain)(object_t *)) {
+    size_t retained = 0;
+    for (gc_ephemeron_table_t *table = heap->ephemeron_tables; table; table = table->next) {
+        for (size_t i = 0; i < table->capacity; i++) {
+            gc_ephemeron_t *e = &table->entries[i];
+            if (!e->key || e->key == EPHEMERON_TOMBSTONE || !e->value) continue;
+            if (survivor(e->key) && !survivor(e->value)) {
+                retain(e->value);
+                if (survivor(e->value)) retained++;
+            }
+        }
+    }
+    return retained;
+}
+
+// Clears the weak slots whose target died, updates the rest to where their target
+// now lives, and forgets weak objects that died themselves.
+static void clear_weak_references(object_t *(*survivor)(object_t *)) {
+    size_t kept = 0;
+    for (size_t i = 0; i < heap->weak_count; i++) {
+        object_t *obj = survivor(heap->weak_objects[i]);
+        if (!obj) continue;
+
+        object_t **slots = obj_children(obj);
+        for (size_t s = 0, n = obj_child_count(obj); s < n; s++) {
+            if (slots[s] && !(slots[s] = survivor(slots[s]))) {
+                heap->gc_stats.weak_refs_cleared++;
+            }
+        }
+        heap->weak_objects[kept++] = obj;
+    }
+    heap->weak_count = kept;
+}
+
+static inline size_t ephemeron_hash(const object_t *key, size_t capacity) {
+    return (size_t)(((uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+static gc_ephemeron_t *ephemeron_find(gc_ephemeron_table_t *table, const object_t *key) {
+    if (!table->capacity) return NULL;
+
+    size_t mask = table->capacity - 1;
+    for (size_t i = ephemeron_hash(key, table->capacity);; i = (i + 1) & mask) {
+        gc_ephemeron_t *e = &table->entries[i];
+        if (e->key == key) return e;
+        if (!e->key) return NULL;
+    }
+}
+
+// Rehashes the live entries into a fresh array of the given capacity. Returns 1 on
+// success; on failure the table is left as it was.
+static int ephemeron_resize(gc_ephemeron_table_t *table, size_t capacity) {
+    gc_ephemeron_t *entries = calloc(capacity, sizeof(gc_ephemeron_t));
+    if (!entries) return 0;
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        gc_ephemeron_t *e = &table->entries[i];
+        if (!e->key || e->key == EPHEMERON_TOMBSTONE) continue;
+
+        size_t j = ephemeron_hash(e->key, capacity);
+        while (entries[j].key) j = (j + 1) & (capacity - 1);
+        entries[j] = *e;
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    table->used = table->count;
+    return 1;
+}
+
+// Smallest capacity that holds count entries at most half full.
+static size_t ephemeron_capacity_for(size_t count) {
+    size_t capacity = EPHEMERON_MIN_CAPACITY;
+    while (capacity < count * 2) capacity *= 2;
+    return capacity;
+}
+
+// Removes the entries whose key died and moves the others to where their key and
+// value now live. Moved keys hash differently, so the table is rebuilt; if that
+// fails the table is emptied - it only ever held what the program could recompute.
+static void sweep_ephemeron_tables(object_t *(*survivor)(object_t *)) {
+    for (gc_ephemeron_table_t *table = heap->ephemeron_tables; table; table = table->next) {
+        int moved = 0;
+        for (size_t i = 0; i < table->capacity; i++) {
+            gc_ephemeron_t *e = &table->entries[i];
+            if (!e->key || e->key == EPHEMERON_TOMBSTONE) continue;
+
+            object_t *key = survivor(e->key);
+            if (!key) {
+                e->key = EPHEMERON_TOMBSTONE;
+                e->value = NULL;
+                table->count--;
+                heap->gc_stats.ephemerons_removed++;
+                continue;
+            }
+            moved |= key != e->key;
+            e->key = key;
+            e->value = survivor(e->value);
+        }
+
+        if (moved && !ephemeron_resize(table, table->capacity)) {
+            memset(table->entries, 0, sizeof(gc_ephemeron_t) * table->capacity);
+            table->count = table->used = 0;
+        }
+    }
+}
+
+void *gc_alloc_weak(size_t size, size_t weak_slots) {
+    object_t *obj = alloc_object(size, weak_slots, GC_WEAK, 0);
+    if (!obj) return NULL;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    if (heap->weak_count == heap->weak_capacity) {
+        size_t capacity = heap->weak_capacity ? heap->weak_capacity * 2 : 64;
+        object_t **grown = realloc(heap->weak_objects, sizeof(object_t *) * capacity);
+        if (grown) {
+            heap->weak_objects = grown;
+            heap->weak_capacity = capacity;
+        }
+    }
+    // An object we cannot register would never have its slots cleared; let it die
+    int registered = heap->weak_count < heap->weak_capacity;
+    if (registered) {
+        heap->weak_objects[heap->weak_count++] = obj;
+    }
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    return registered ? obj_data(obj) : NULL;
+}
+
+gc_ephemeron_table_t *gc_ephemeron_table_create(void) {
+    gc_ephemeron_table_t *table = calloc(1, sizeof(gc_ephemeron_table_t));
+    if (!table) return NULL;
+
+    table->heap = heap;
+    pthread_mutex_lock(&heap->gc_lock);
+    table->next = heap->ephemeron_tables;
+    heap->ephemeron_tables = table;
+    pthread_mutex_unlock(&heap->gc_lock);
+    return table;
+}
+
+void gc_ephemeron_table_destroy(gc_ephemeron_table_t *table) {
+    if (!table) return;
+
+    gc_heap_t *owner = table->heap;
+    if (owner) {
+        pthread_mutex_lock(&owner->gc_lock);
+        gc_ephemeron_table_t **pp = &owner->ephemeron_tables;
+        while (*pp && *pp != table) {
+            pp = &(*pp)->next;
+        }
+        if (*pp) {
+            *pp = table->next;
+        }
+        pthread_mutex_unlock(&owner->gc_lock);
+    }
+
+    free(table->entries);
+    free(table);
+}
+
+int gc_ephemeron_table_put(gc_ephemeron_table_t *table, object_t *key, object_t *value) {
+    if (!table || !key || !table->heap) return 0;
+
+    // The table is not an object the barrier sees, so entries escape any region here
+    region_escape_object(key);
+    region_escape_object(value);
+
+    pthread_mutex_lock(&table->heap->gc_lock);
+    gc_ephemeron_t *e = ephemeron_find(table, key);
+    if (e) {
+        e->value = value;
+        pthread_mutex_unlock(&table->heap->gc_lock);
+        return 1;
+    }
+
+    // Keep at least a quarter of the slots never used so probes terminate quickly
+    if ((table->used + 1) * 4 > table->capacity * 3 &&
+        !ephemeron_resize(table, ephemeron_capacity_for(table->count + 1))) {
+        pthread_mutex_unlock(&table->heap->gc_lock);
+        return 0;
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t i = ephemeron_hash(key, table->capacity);
+    while (table->entries[i].key && table->entries[i].key != EPHEMERON_TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (!table->entries[i].key) table->used++;
+    table->entries[i].key = key;
+    table->entries[i].value = value;
+    table->count++;
+    pthread_mutex_unlock(&table->heap->gc_lock);
+    return 1;
+}
+
+object_t *gc_ephemeron_table_get(gc_ephemeron_table_t *table, object_t *key) {
+    if (!table || !key || !table->heap) return NULL;
+
+    pthread_mutex_lock(&table->heap->gc_lock);
+    gc_ephemeron_t *e = ephemeron_find(table, key);
+    object_t *value = e ? e->value : NULL;
+    pthread_mutex_unlock(&table->heap->gc_lock);
+    return value;
+}
+
+int gc_ephemeron_table_remove(gc_ephemeron_table_t *table, object_t *key) {
+    if (!table || !key || !table->heap) return 0;
+
+    pthread_mutex_lock(&table->heap->gc_lock);
+    gc_ephemeron_t *e = ephemeron_find(table, key);
+    if (e) {
+        e->key = EPHEMERON_TOMBSTONE;
+        e->value = NULL;
+        table->count--;
+    }
+    pthread_mutex_unlock(&table->heap->gc_lock);
+    return e != NULL;
+}
+
+size_t gc_ephemeron_table_count(gc_ephemeron_table_t *table) {
+    if (!table || !table->heap) return 0;
+
+    pthread_mutex_lock(&table->heap->gc_lock);
+    size_t count = table->count;
+    pthread_mutex_unlock(&table->heap->gc_lock);
+    return count;
+}
+
+/* ========================= FINALIZATION ========================= */
+
+// Moves registered objects that tracing left dead to the finalization queue and
+// retains them, returning how many were queued. The caller then traces from them
+// again, so a finalizer finds everything its object refers to intact. Nothing is
+// queued twice: a finalizer that stores its object somewhere resurrects it for good.
+static size_t queue_finalizable(object_t *(*survivor)(object_t *), void (*retain)(object_t *)) {
+    size_t queued = 0;
+    gc_finalizable_t **pp = &heap->finalizable;
+    while (*pp) {
+        gc_finalizable_t *f = *pp;
+        object_t *obj = survivor(f->obj);
+        if (obj) {
+            f->obj = obj;
+            pp = &f->next;
+            continue;
+        }
+
+        *pp = f->next;
+        retain(f->obj);
+        f->obj = survivor(f->obj);
+        f->next = NULL;
+        *heap->finalize_queue_tail = f;
+        heap->finalize_queue_tail = &f->next;
+        queued++;
+    }
+
+    if (queued) {
+        heap->gc_stats.finalizers_queued += queued;
+        pthread_cond_signal(&heap->finalizer_cond);
+    }
+    return queued;
+}
+
+void *gc_alloc_finalizable(size_t size, size_t child_slots, gc_finalizer_t finalizer) {
+    gc_finalizable_t *f = malloc(sizeof(gc_finalizable_t));
+    if (!f) return NULL;
+
+    object_t *obj = alloc_object(size, child_slots, 0, 0);
+    if (!obj) {
+        free(f);
+        return NULL;
+    }
+
+    f->obj = obj;
+    f->finalizer = finalizer;
+    pthread_mutex_lock(&heap->gc_lock);
+    f->next = heap->finalizable;
+    heap->finalizable = f;
+    pthread_mutex_unlock(&heap->gc_lock);
+    return obj_data(obj);
+}
+
+// Runs up to GC_FINALIZER_BATCH finalizers from the head of the queue without
+// holding gc_lock, so collections proceed meanwhile. Returns how many ran.
+static size_t run_finalizer_batch(void) {
+    pthread_mutex_lock(&heap->gc_lock);
+    size_t n = 0;
+    gc_finalizable_t **tail = &heap->finalizing;
+    while (heap->finalize_queue && n < GC_FINALIZER_BATCH) {
+        gc_finalizable_t *f = heap->finalize_queue;
+        heap->finalize_queue = f->next;
+        f->next = NULL;
+        *tail = f;
+        tail = &f->next;
+        n++;
+    }
+    if (!heap->finalize_queue) heap->finalize_queue_tail = &heap->finalize_queue;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    for (gc_finalizable_t *f = heap->finalizing; f; f = f->next) {
+        if (f->finalizer) f->finalizer(obj_data(f->obj));
+    }
+
+    pthread_mutex_lock(&heap->gc_lock);
+    gc_finalizable_t *done = heap->finalizing;
+    heap->finalizing = NULL;
+    heap->gc_stats.finalizers_run += n;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    free_finalizable_list(done);
+    return n;
+}
+
+size_t gc_run_finalizers(void) {
+    size_t total = 0, n;
+    lock_parked(&heap->finalizer_lock);
+    while ((n = run_finalizer_batch())) {
+        total += n;
+    }
+    pthread_mutex_unlock(&heap->finalizer_lock);
+    return total;
+}
+
+static void *finalizer_thread_main(void *arg) {
+    heap = arg;
+    pthread_mutex_lock(&heap->gc_lock);
+    while (!heap->finalizer_thread_stopping) {
+        if (!heap->finalize_queue) {
+            // Idle, so a stop need not wait for this thread
+            if (current_thread && !current_thread->parked) {
+                __atomic_store_n(&current_thread->parked, 1, __ATOMIC_SEQ_CST);
+                pthread_cond_broadcast(&heap->stop_cond);
+            }
+            pthread_cond_wait(&heap->finalizer_cond, &heap->gc_lock);
+            continue;
+        }
+        wait_for_resume(heap, current_thread);
+        pthread_mutex_unlock(&heap->gc_lock);
+        gc_run_finalizers();
+        pthread_mutex_lock(&heap->gc_lock);
+    }
+    pthread_mutex_unlock(&heap->gc_lock);
+    return NULL;
+}
+
+int gc_finalizer_thread_start(void) {
+    pthread_mutex_lock(&heap->gc_lock);
+    int running = heap->finalizer_thread_running;
+    heap->finalizer_thread_stopping = 0;
+    pthread_mutex_unlock(&heap->gc_lock);
+    if (running) return 1;
+
+    if (pthread_create(&heap->finalizer_thread, NULL, finalizer_thread_main, heap) != 0) return 0;
+    heap->finalizer_thread_running = 1;
+    return 1;
+}
+
+void gc_finalizer_thread_stop(void) {
+    if (!heap->finalizer_thread_running) return;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->finalizer_thread_stopping = 1;
+    pthread_cond_broadcast(&heap->finalizer_cond);
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    // Its last batch may collect, and must not wait for this thread to stop
+    gc_thread_t *thread = current_thread;
+    int was_parked = !thread || thread->parked;
+    if (!was_parked) thread_park(thread);
+    pthread_join(heap->finalizer_thread, NULL);
+    if (!was_parked) thread_unpark(thread);
+    heap->finalizer_thread_running = 0;
+}
+
+/* ========================= WRITE BARRIER ========================= */
+
+// Takes the thread's spare segment, or a new one, and links it after the full tail.
+// Returns NULL only if there was no spare and malloc failed.
+static barrier_chunk_t *barrier_extend(gc_thread_t *thread) {
+    barrier_chunk_t *chunk = __atomic_exchange_n(&thread->barrier_spare, NULL, __ATOMIC_ACQUIRE);
+    if (!chunk && !(chunk = calloc(1, sizeof(barrier_chunk_t)))) return NULL;
+
+    // The collector treats a linked successor as proof that the tail is full
+    __atomic_store_n(&thread->barrier_tail->next, chunk, __ATOMIC_RELEASE);
+    thread->barrier_tail = chunk;
+    return chunk;
+}
+
+// Pushes a card-only item for every card of a large array the barrier dirtied, and
+// returns how many it pushed. The queued flag is cleared before the cards are taken,
+// so a store racing with this either has its card taken here or queues the array
+// again. A card that finds the mark stack full is scanned on the spot instead.
+// Called with gc_lock held.
+static size_t push_dirty_cards(object_t *obj) {
+    los_mapping_t *m = is_tracked_object(obj) ? card_marked_mapping(obj) : NULL;
+    if (!m) return 0;
+
+    __atomic_store_n(&m->queued, 0, __ATOMIC_SEQ_CST);
+    size_t cards = (obj_child_count(obj) + GC_SCAN_CHUNK - 1) / GC_SCAN_CHUNK;
+    size_t pushed = 0;
+    for (size_t w = 0; w < (cards + 63) / 64; w++) {
+        uint64_t bits = __atomic_exchange_n(&m->cards[w], 0, __ATOMIC_SEQ_CST);
+        for (; bits; bits &= bits - 1) {
+            size_t start = (w * 64 + (size_t)__builtin_ctzll(bits)) * GC_SCAN_CHUNK;
+            if (!push_mark_stack(obj, start | MARK_CARD_ONLY)) {
+                scan_item((mark_item_t){ obj, start | MARK_CARD_ONLY });
+                flush_prefetch_fifo();
+            }
+            pushed++;
+        }
+    }
+    heap->gc_stats.cards_rescanned += pushed;
+    return pushed;
+}
+
+// The barrier's slow path: the store hid an unmarked child behind a marked parent.
+// Records the child in this thread's buffer for the collector to mark; no lock is
+// taken except to register a thread on its first store, or if memory runs out.
+// Stores into large arrays dirty a card instead, and the array is queued once, as a
+// tagged pointer, until the collector has rescanned its dirty cards.
+static void barrier_record(object_t *parent, object_t **field, object_t *child) {
+    gc_thread_t *thread = current_thread;
+    if (!thread && !(thread = gc_thread_register())) return;
+
+    object_t *entry = child;
+    los_mapping_t *m = card_marked_mapping(parent);
+    size_t slot = (size_t)(field - obj_children(parent));
+    if (m && field >= obj_children(parent) && slot < obj_child_count(parent)) {
+        size_t card = slot / GC_SCAN_CHUNK;
+        __atomic_fetch_or(&m->cards[card / 64], 1ULL << (card % 64), __ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&m->queued, 1, __ATOMIC_SEQ_CST)) return;
+        entry = (object_t *)((uintptr_t)parent | 1);
+    }
+
+    barrier_chunk_t *chunk = thread->barrier_tail;
+    size_t count = chunk->count;
+    if (count == GC_BARRIER_CHUNK) {
+        if (!(chunk = barrier_extend(thread))) {
+            pthread_mutex_lock(&heap->gc_lock);
+            if (heap->gc_phase == GC_PHASE_MARK) {
+                if (entry == child) {
+                    mark_object(child);
+                } else {
+                    push_dirty_cards(parent);
+                }
+            }
+            pthread_mutex_unlock(&heap->gc_lock);
+            return;
+        }
+        count = 0;
+    }
+    chunk->entries[count] = entry;
+    __atomic_store_n(&chunk->count, count + 1, __ATOMIC_RELEASE);
+}
+
+// The inline barrier only knows that some heap is marking. The store is recorded by
+// the parent's heap, which need not be the one this thread is using, if that heap is.
+void gc_write_barrier_slow(object_t *parent, object_t **field, object_t *child) {
+    gc_heap_t *owner = heap;
+    if (__atomic_load_n(&gc_heap_count, __ATOMIC_RELAXED) > 1) {
+        gc_chunk_t *chunk;
+        owner = object_containing(parent, &chunk) ? chunk->heap : NULL;
+    }
+    if (!owner || !__atomic_load_n(&owner->barrier_active, __ATOMIC_RELAXED)) return;
+
+    gc_heap_t *saved = heap;
+    if (owner != saved) {
+        heap_switch(owner);
+    } else if (current_thread && current_thread->parked) {
+        thread_unpark(current_thread);
+    }
+    barrier_record(parent, field, child);
+    // Once recorded, the store is safe to stop after
+    safepoint_poll();
+    if (owner != saved) heap_switch(saved);
+}
+
+// Marks everything the thread's barrier recorded since the last drain, and pushes the
+// dirty cards of the arrays it queued. Returns how many objects were still unmarked
+// plus the cards pushed. Fully consumed segments go back to the thread as its spare.
+// Called with gc_lock held.
+static size_t drain_thread_barrier(gc_thread_t *thread) {
+    size_t shaded = 0;
+    barrier_chunk_t *chunk = thread->barrier_head;
+    for (;;) {
+        // Load next first: once it is set, the producer has finished with chunk
+        barrier_chunk_t *next = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE);
+        size_t count = __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+        for (size_t i = thread->barrier_consumed; i < count; i++) {
+            object_t *child = chunk->entries[i];
+            if ((uintptr_t)child & 1) {
+                shaded += push_dirty_cards((object_t *)((uintptr_t)child - 1));
+            } else if (!(child->header & GC_MARKED)) {
+                mark_object(child);
+                shaded++;
+            }
+        }
+        thread->barrier_consumed = count;
+        if (!next) return shaded;
+
+        thread->barrier_head = next;
+        thread->barrier_consumed = 0;
+        chunk->next = NULL;
+        chunk->count = 0;
+        free(__atomic_exchange_n(&thread->barrier_spare, chunk, __ATOMIC_RELEASE));
+        chunk = next;
+    }
+}
+
+static size_t drain_barrier_buffers(void) {
+    size_t shaded = 0;
+    for (gc_thread_t *thread = heap->gc_threads; thread; thread = thread->next) {
+        shaded += drain_thread_barrier(thread);
+    }
+    return shaded;
+}
+
+void gc_write_barrier(object_t *parent, size_t slot, object_t *child) {
+    if (!parent || slot >= obj_slot_count(parent)) return;
+    gc_write_barrier_field(parent, obj_slot(parent, slot), child);
+}
+
+void gc_write_barrier_at(object_t **field, object_t *child) {
+    object_t *parent = object_containing(field, NULL);
+    if (parent) gc_write_barrier_field(parent, field, child);
+}
+
+/* ========================= INCREMENTAL COLLECTION ========================= */
+
+// Adds ns to a phase's time for the cycle in flight and to its running total.
+static inline void charge_phase(uint64_t *cycle_ns, uint64_t *total_ns, uint64_t ns) {
+    *cycle_ns += ns;
+    *total_ns += ns;
+}
+
+static void scan_roots(void) {
+    visit_roots(mark_root);
+    mark_region_objects();
+    if (heap->gc_conservative_roots) {
+        scan_thread_stacks();
+    }
+}
+
+// Starts a cycle from a snapshot of the roots. From here until marking finishes,
+// new objects are born black and the write barrier shades stored pointers.
+static void begin_cycle(void) {
+    heap->gc_epoch++;
+    __atomic_fetch_add(&gc_cycles, 1, __ATOMIC_RELAXED);
+    heap->gc_phase = GC_PHASE_MARK;
+    set_barrier_active(1);
+    heap->cycle_root_scan_ns = heap->cycle_mark_ns = heap->cycle_sweep_ns = 0;
+    heap->cycle_work = 0;
+    heap->cycle_start_bytes_marked = heap->gc_stats.bytes_marked;
+
+    uint64_t start = tb_now_ns();
+    scan_roots();
+    charge_phase(&heap->cycle_root_scan_ns, &heap->gc_stats.root_scan_ns, tb_now_ns() - start);
+}
+
+// The roots are not behind the write barrier, so once the heap has been drained
+// they are scanned again and the graph drained to a fixpoint, which includes the
+// values of ephemerons whose keys turned out live and everything reachable from
+// finalizable objects found dead. The other threads are stopped at safepoints for
+// all of it, so no root or store can change under the final scan; the wait for
+// them counts as root scanning. This last step ignores the slice's work budget;
+// only its deadline or a critical event cuts it short, and then the world resumes
+// and the next slice drains what is left and rescans the roots again. Once marking is complete, weak
+// references and ephemerons to unmarked objects are cleared before anything is
+// swept. Returns 1 once marking is done.
+static int finish_marking(gc_budget_t *budget) {
+    uint64_t start = tb_now_ns();
+    stop_mutators();
+    scan_roots();
+    drain_barrier_buffers();
+    uint64_t roots_done = tb_now_ns();
+
+    gc_budget_t rest = { budget->deadline, SIZE_MAX, 0 };
+    int drained;
+    do {
+        do {
+            drained = drain_mark_stack_until(&rest);
+            if (drained) {
+                rescan_overflowed();
+            }
+        } while (drained && (drain_barrier_buffers() || retain_ephemeron_values(mark_survivor, mark_object)));
+    } while (drained && queue_finalizable(mark_survivor, mark_object));
+
+    if (drained) {
+        clear_weak_references(mark_survivor);
+        sweep_ephemeron_tables(mark_survivor);
+    }
+
+    charge_phase(&heap->cycle_root_scan_ns, &heap->gc_stats.root_scan_ns, roots_done - start);
+    charge_phase(&heap->cycle_mark_ns, &heap->gc_stats.mark_ns, tb_now_ns() - roots_done);
+    if (!drained) {
+        resume_mutators();
+        budget->preempted = rest.preempted;
+        return 0;
+    }
+
+    heap->gc_phase = GC_PHASE_SWEEP;
+    set_barrier_active(0);
+    resume_mutators();
+    heap->sweep_cursor = next_chunk(NULL);
+    return 1;
+}
+
+// Frees the unmarked objects of chunk in place and returns the chunk to the allocator
+// if it holds nothing live and no longer backs a TLAB. Returns the objects visited.
+// The starts bitmap is split by the marks a word at a time, so objects freed in
+// earlier cycles are never visited again, and a chunk that turns out entirely dead is
+// freed without touching any of its objects. Called with the chunk busy, so its owner
+// cannot allocate meanwhile and every object in the starts is formatted, carrying
+// its birth mark; the chunk is released unless it was freed.
+static size_t sweep_chunk(gc_chunk_t *chunk) {
+    chunk->swept = heap->gc_epoch;
+
+    enum { WORDS = TLAB_GRANULES / 64 };
+    uint64_t live[WORDS], dead[WORDS];
+    int any_live = tb_split_marks(chunk->starts, chunk->marks, live, dead, WORDS);
+
+    size_t visited = 0;
+    if (!any_live && !chunk->owned) {
+        for (size_t w = 0; w < WORDS; w++) {
+            visited += (size_t)__builtin_popcountll(dead[w]);
+        }
+        heap->gc_stats.objects_freed += visited;
+        heap->gc_stats.bytes_freed += (size_t)(chunk->top - chunk->data) - chunk->free_bytes;
+    } else {
+        for (size_t w = 0; w < WORDS; w++) {
+            for (uint64_t bits = live[w]; bits; bits &= bits - 1) {
+                // Survivor: clear the mark and bump its age
+                object_t *obj = (object_t *)(chunk->data + (w * 64 + (size_t)__builtin_ctzll(bits)) * TLAB_GRANULE);
+                uint64_t age = obj->header & GC_AGE_MASK;
+                if (age != GC_AGE_MASK) age += 1ULL << GC_AGE_SHIFT;
+                obj->header = (obj->header & ~(GC_MARKED | GC_SCANNED | GC_AGE_MASK)) | age;
+                visited++;
+            }
+            for (uint64_t bits = dead[w]; bits; bits &= bits - 1) {
+                object_t *obj = (object_t *)(chunk->data + (w * 64 + (size_t)__builtin_ctzll(bits)) * TLAB_GRANULE);
+                size_t extent = obj_extent(obj);
+                heap->gc_stats.objects_freed++;
+                heap->gc_stats.bytes_freed += extent;
+                chunk->free_bytes += tlab_align(extent);
+                obj->header |= GC_FREE;
+                visited++;
+            }
+            if (dead[w]) __atomic_fetch_and(&chunk->starts[w], ~dead[w], __ATOMIC_RELAXED);
+            if (live[w]) __atomic_fetch_and(&chunk->marks[w], ~live[w], __ATOMIC_RELAXED);
+        }
+    }
+
+    if (!any_live && !chunk->owned) {
+        __atomic_fetch_sub(&heap->gc_heap_bytes, (size_t)(chunk->limit - (uint8_t *)chunk), __ATOMIC_RELAXED);
+        if (chunk->mapped) {
+            los_chunk_free(chunk);
+        } else {
+            tb_free(chunk);
+        }
+    } else {
+        chunk_unlock(chunk);
+    }
+    return visited;
+}
+
+// Sweeps chunks in address order from the cursor until none are left (returning 1)
+// or the budget runs out; a chunk is never split. The clock is read after every
+// chunk, since one can hold a thousand objects. Only the sweeper frees chunks, so
+// the cursor stays valid between slices; chunks created since sweeping began are
+// already marked swept.
+static int sweep_until(gc_budget_t *budget) {
+    size_t since_check = 0;
+    while (heap->sweep_cursor) {
+        // Fetch the successor first; freeing this chunk may merge its block
+        gc_chunk_t *chunk = heap->sweep_cursor;
+        heap->sweep_cursor = next_chunk(chunk);
+        if (chunk->swept == heap->gc_epoch) continue;
+
+        chunk_lock(chunk);
+        size_t visited = sweep_chunk(chunk);
+        if (charge_work(budget, visited, &since_check) || past_deadline(budget)) break;
+    }
+    return heap->sweep_cursor == NULL;
+}
+
+// Sets the next trigger from the cycle that just ended. The live size alone asks for
+// a heap of live / target_live_ratio. On top of that, when the policy started the
+// cycle, a collector taking more than target_gc_ratio of the time since the previous
+// cycle ended stretches the goal by the overshoot, up to double, so collections
+// happen less often. A collector taking less shrinks the goal, down to half, but
+// never below the live-size goal. Cycles the program asked for say nothing about
+// what the policy costs and only move the live-size floor. Capacity is added when
+// the goal, plus a quarter for fragmentation, no longer fits.
+static void update_heap_goal(void) {
+    uint64_t now = tb_now_ns();
+    uint64_t gc_ns = heap->cycle_root_scan_ns + heap->cycle_mark_ns + heap->cycle_sweep_ns;
+    uint64_t elapsed = now - heap->last_cycle_end_ns;
+    heap->last_cycle_end_ns = now;
+
+    double live = (double)(heap->gc_stats.bytes_marked - heap->cycle_start_bytes_marked);
+    double live_goal = heap->heap_policy.target_live_ratio > 0 ? live / heap->heap_policy.target_live_ratio : live;
+    double goal = (double)heap->heap_goal;
+    if (heap->cycle_automatic && heap->heap_policy.target_gc_ratio > 0 && elapsed > 0) {
+        double factor = ((double)gc_ns / (double)elapsed) / heap->heap_policy.target_gc_ratio;
+        if (factor < 0.5) factor = 0.5;
+        if (factor > 2.0) factor = 2.0;
+        goal *= factor;
+    }
+    if (goal < live_goal) goal = live_goal;
+    if (goal < HEAP_SIZE / 4) goal = HEAP_SIZE / 4;
+    if (goal > (double)heap->heap_policy.max_heap_bytes) goal = (double)heap->heap_policy.max_heap_bytes;
+    heap->heap_goal = (size_t)goal;
+
+    while (tb_allocator_capacity(heap->allocator) < heap->heap_goal + heap->heap_goal / 4 && heap_may_grow() && tb_allocator_grow(heap->allocator)) {
+        heap->gc_stats.heap_grows++;
+    }
+}
+
+static void end_cycle(void) {
+    heap->gc_phase = GC_PHASE_IDLE;
+    update_heap_goal();
+    los_trim_cache(__atomic_load_n(&gc_cycles, __ATOMIC_RELAXED));
+    heap->gc_stats.collections++;
+    heap->gc_stats.last_root_scan_ns = heap->cycle_root_scan_ns;
+    heap->gc_stats.last_mark_ns = heap->cycle_mark_ns;
+    heap->gc_stats.last_sweep_ns = heap->cycle_sweep_ns;
+    heap->gc_bytes_at_cycle_end = __atomic_load_n(&heap->gc_bytes_allocated, __ATOMIC_RELAXED);
+    heap->last_cycle_work = heap->cycle_work;
+}
+
+// Advances the mark-sweep cycle - starting one if the collector is idle - until the
+// budget runs out or the cycle completes. Returns 1 if it completed. Called with
+// gc_lock held.
+static int mark_sweep_slice(gc_budget_t *budget) {
+    if (heap->gc_phase == GC_PHASE_IDLE) {
+        begin_cycle();
+    }
+
+    if (heap->gc_phase == GC_PHASE_MARK) {
+        uint64_t start = tb_now_ns();
+        drain_barrier_buffers();
+        int drained = drain_mark_stack_until(budget);
+        charge_phase(&heap->cycle_mark_ns, &heap->gc_stats.mark_ns, tb_now_ns() - start);
+        if (!drained || !budget->work || past_deadline(budget)) return 0;
+        if (!finish_marking(budget)) return 0;
+    }
+
+    uint64_t start = tb_now_ns();
+    int swept = sweep_until(budget);
+    charge_phase(&heap->cycle_sweep_ns, &heap->gc_stats.sweep_ns, tb_now_ns() - start);
+    if (!swept) return 0;
+
+    end_cycle();
+    return 1;
+}
+
+/* ========================= SEMISPACE COLLECTOR ========================= */
+
+// Copies obj into the reserve space (once) and returns its new address.
+// Pointers outside the active space are not ours to move and are returned as is.
+static object_t *semispace_copy(object_t *obj) {
+    if (!obj || !in_semispace(heap->ss_active, obj)) return obj;
+    if (obj->header & GC_FORWARDED) return (object_t *)(uintptr_t)(obj->header & ~GC_FORWARDED);
+
+    size_t object_size = obj_extent(obj);
+    object_t *copy = (object_t *)heap->ss_alloc_ptr;
+    heap->ss_alloc_ptr += ss_align(object_size);
+
+    memcpy(copy, obj, object_size);
+    heap->gc_stats.objects_marked++;
+    heap->gc_stats.bytes_marked += object_size;
+
+    // Everything the old copy described is now in the new one; reuse its header
+    // word for the forwarding address
+    obj->header = (uint64_t)(uintptr_t)copy | GC_FORWARDED;
+    return copy;
+}
+
+static void semispace_copy_slot(object_t **slot) {
+    *slot = semispace_copy(*slot);
+}
+
+static void semispace_retain(object_t *obj) {
+    semispace_copy(obj);
+}
+
+// Where a from-space object went: its copy, or NULL if it was left behind. Objects
+// outside the from-space are not ours and always survive.
+static object_t *semispace_survivor(object_t *obj) {
+    if (!obj || !in_semispace(heap->ss_active, obj)) return obj;
+    return (obj->header & GC_FORWARDED) ? (object_t *)(uintptr_t)(obj->header & ~GC_FORWARDED) : NULL;
+}
+
+// Cheney's algorithm: copy the roots, then scan the reserve space breadth-first,
+// copying every child we find until the scan pointer catches the allocation pointer.
+// Root copying counts as the root scan and the Cheney scan as marking; there is
+// no sweep, and everything left behind in the old space is reported as freed.
+static void semispace_collect(void) {
+    uint64_t start = tb_now_ns();
+    size_t used_before = (size_t)(heap->ss_alloc_ptr - heap->ss_active);
+    uint64_t objects_before = heap->gc_stats.objects_marked;
+    heap->cycle_start_bytes_marked = heap->gc_stats.bytes_marked;
+
+    heap->ss_alloc_ptr = heap->ss_reserve;
+    heap->ss_scan_ptr = heap->ss_reserve;
+
+    visit_roots(semispace_copy);
+    uint64_t roots_done = tb_now_ns();
+
+    do {
+        do {
+            while (heap->ss_scan_ptr < heap->ss_alloc_ptr) {
+                object_t *obj = (object_t *)heap->ss_scan_ptr;
+                scan_object(obj, semispace_copy_slot);
+                heap->ss_scan_ptr += ss_align(obj_extent(obj));
+            }
+        } while (retain_ephemeron_values(semispace_survivor, semispace_retain));
+    } while (queue_finalizable(semispace_survivor, semispace_retain));
+
+    clear_weak_references(semispace_survivor);
+    sweep_ephemeron_tables(semispace_survivor);
+
+    uint8_t *old_space = heap->ss_active;
+    heap->ss_active = heap->ss_reserve;
+    heap->ss_reserve = old_space;
+
+    size_t copied = (size_t)(heap->gc_stats.objects_marked - objects_before);
+    heap->gc_stats.objects_freed += heap->ss_object_count - copied;
+    heap->gc_stats.bytes_freed += used_before - (size_t)(heap->ss_alloc_ptr - heap->ss_active);
+    heap->ss_object_count = copied;
+
+    heap->cycle_root_scan_ns = heap->cycle_mark_ns = heap->cycle_sweep_ns = 0;
+    charge_phase(&heap->cycle_root_scan_ns, &heap->gc_stats.root_scan_ns, roots_done - start);
+    charge_phase(&heap->cycle_mark_ns, &heap->gc_stats.mark_ns, tb_now_ns() - roots_done);
+    end_cycle();
+}
+
+object_t *gc_forward(object_t *obj) {
+    if (heap->gc_mode != GC_MODE_SEMISPACE || !obj) return obj;
+    if (in_semispace(heap->ss_active, obj)) return obj;
+    if (in_semispace(heap->ss_reserve, obj) && (obj->header & GC_FORWARDED)) {
+        return (object_t *)(uintptr_t)(obj->header & ~GC_FORWARDED);
+    }
+    return NULL;
+}
+
+static void record_gc_pause(uint64_t duration_ns) {
+    heap->gc_stats.pause_count++;
+    heap->gc_stats.pause_total_ns += duration_ns;
+    tb_histogram_record(&heap->pause_histogram, duration_ns);
+}
+
+// Lets a critical event in while a collection that has to finish is preempted: the
+// pause ends, gc_lock is dropped for the yield hook with this thread parked, and a
+// new pause starts once the lock is back. Called with gc_lock held.
+static void yield_to_critical_event(uint64_t *pause_start) {
+    void (*yield)(void *) = heap->preemption.emergency_yield;
+    void *arg = heap->preemption.arg;
+
+    record_gc_pause(tb_now_ns() - *pause_start);
+    gc_thread_t *self = current_thread;
+    if (self) {
+        __atomic_store_n(&self->parked, 1, __ATOMIC_SEQ_CST);
+        pthread_cond_broadcast(&heap->stop_cond);
+    }
+    pthread_mutex_unlock(&heap->gc_lock);
+    if (yield) {
+        yield(arg);
+    } else {
+        sched_yield();
+    }
+    pthread_mutex_lock(&heap->gc_lock);
+    // Whoever collected during the yield may still have the world stopped
+    wait_for_resume(heap, self);
+    *pause_start = tb_now_ns();
+    preempt_begin(*pause_start);
+}
+
+// Runs the cycle in flight to its end, yielding to critical events on the way. The
+// cycle resumes where it stopped unless whoever ran during a yield finished it.
+static void finish_cycle(uint64_t *pause_start) {
+    uint32_t epoch = heap->gc_epoch;
+    while (heap->gc_phase != GC_PHASE_IDLE && heap->gc_epoch == epoch) {
+        gc_budget_t rest = unlimited_budget;
+        if (mark_sweep_slice(&rest)) return;
+        yield_to_critical_event(pause_start);
+    }
+}
+
+// Runs collector work within budget and records it as one pause. A copying
+// collection cannot be split, so in semispace mode every slice is a whole cycle.
+// With full set, a cycle already in flight is finished first and a fresh one run,
+// so everything unreachable at the call is reclaimed; critical events are let in
+// between pauses. Otherwise a critical event ends the slice, or skips it if one is
+// already pending.
+static gc_status_t run_slice(gc_budget_t *budget, int full) {
+    pthread_mutex_lock(&heap->gc_lock);
+    // Another thread's collector may have the world stopped while it waits for a lock
+    gc_thread_t *self = current_thread;
+    if (heap->world_stopped || (self && self->parked)) {
+        wait_for_resume(heap, self);
+    }
+    if (!full && critical_event_pending()) {
+        heap->gc_stats.preemptions++;
+        pthread_mutex_unlock(&heap->gc_lock);
+        return GC_YIELD_CRITICAL;
+    }
+    uint64_t start = tb_now_ns();
+    preempt_begin(start);
+
+    gc_status_t status = GC_CYCLE_COMPLETE;
+    if (heap->gc_mode == GC_MODE_SEMISPACE) {
+        semispace_collect();
+    } else if (full) {
+        if (heap->gc_phase != GC_PHASE_IDLE) {
+            finish_cycle(&start);
+        }
+        if (heap->gc_phase == GC_PHASE_IDLE) {
+            begin_cycle();
+        }
+        finish_cycle(&start);
+    } else if (!mark_sweep_slice(budget)) {
+        status = budget->preempted ? GC_YIELD_CRITICAL : GC_YIELD_BUDGET;
+    }
+
+    record_gc_pause(tb_now_ns() - start);
+    pthread_mutex_unlock(&heap->gc_lock);
+    return status;
+}
+
+int gc_collect_step(void) {
+    gc_budget_t budget = { UINT64_MAX, GC_STEP_WORK, 0 };
+    return run_slice(&budget, 0) == GC_CYCLE_COMPLETE;
+}
+
+gc_status_t gc_collect_preemptible(void) {
+    gc_budget_t budget = unlimited_budget;
+    return run_slice(&budget, 0);
+}
+
+void gc_collect_full(void) {
+    gc_budget_t budget = unlimited_budget;
+    run_slice(&budget, 1);
+}
+
+/* ========================= SCHEDULER ========================= */
+
+// GC time recorded in the window [from, to). Walks the history newest first and
+// stops at the first quantum that ended before the window.
+static uint64_t sched_gc_time(uint64_t from, uint64_t to) {
+    uint64_t total = 0;
+    size_t n = heap->sched_history_count < GC_SCHED_HISTORY ? heap->sched_history_count : GC_SCHED_HISTORY;
+    for (size_t i = 0; i < n; i++) {
+        const gc_quantum_t *q = &heap->sched_history[(heap->sched_history_count - 1 - i) % GC_SCHED_HISTORY];
+        if (q->end <= from) break;
+
+        uint64_t lo = q->start > from ? q->start : from;
+        uint64_t hi = q->end < to ? q->end : to;
+        if (hi > lo) total += hi - lo;
+    }
+    return total;
+}
+
+// Records a quantum and the utilization of the window that ends with it. The window
+// with the least mutator time always ends at some quantum's end, so the minimum over
+// these is the MMU of the run so far.
+static void sched_record(uint64_t start, uint64_t end) {
+    heap->sched_history[heap->sched_history_count++ % GC_SCHED_HISTORY] = (gc_quantum_t){ start, end };
+
+    uint64_t window = heap->sched_config.window_ns;
+    uint64_t gc_time = sched_gc_time(end > window ? end - window : 0, end);
+    if (gc_time > window) gc_time = window;
+    double utilization = 1.0 - (double)gc_time / (double)window;
+
+    uint64_t length = end - start;
+    heap->sched_stats.quanta++;
+    heap->sched_stats.gc_ns += length;
+    if (length > heap->sched_stats.max_quantum_ns) heap->sched_stats.max_quantum_ns = length;
+    if (utilization < heap->sched_stats.mmu) heap->sched_stats.mmu = utilization;
+}
+
+void gc_scheduler_start(const gc_scheduler_config_t *config) {
+    gc_scheduler_config_t defaults = {
+        .window_ns = 10000000,
+        .target_mmu = 0.7,
+        .quantum_ns = 500000,
+        .trigger_bytes = HEAP_SIZE / 4,
+    };
+    if (!config) config = &defaults;
+
+    lock_parked(&heap->sched_lock);
+    heap->sched_config = *config;
+    if (heap->sched_config.window_ns == 0) heap->sched_config.window_ns = defaults.window_ns;
+    if (heap->sched_config.target_mmu < 0.0) heap->sched_config.target_mmu = 0.0;
+    if (heap->sched_config.target_mmu > 1.0) heap->sched_config.target_mmu = 1.0;
+
+    // A quantum longer than the window's GC budget could never be scheduled
+    uint64_t budget = (uint64_t)((1.0 - heap->sched_config.target_mmu) * (double)heap->sched_config.window_ns);
+    if (heap->sched_config.quantum_ns == 0 || heap->sched_config.quantum_ns > budget) {
+        heap->sched_config.quantum_ns = budget;
+    }
+
+    memset(&heap->sched_stats, 0, sizeof(heap->sched_stats));
+    heap->sched_stats.mmu = 1.0;
+    heap->sched_history_count = 0;
+    __atomic_store_n(&heap->sched_enabled, heap->sched_config.quantum_ns > 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&heap->sched_lock);
+}
+
+void gc_scheduler_stop(void) {
+    lock_parked(&heap->sched_lock);
+    __atomic_store_n(&heap->sched_enabled, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&heap->sched_lock);
+}
+
+int gc_scheduler_poll(void) {
+    if (!__atomic_load_n(&heap->sched_enabled, __ATOMIC_ACQUIRE)) return 0;
+    // Another thread is already running a quantum; keep the mutator going
+    if (pthread_mutex_trylock(&heap->sched_lock) != 0) return 0;
+    if (!heap->sched_enabled) {
+        pthread_mutex_unlock(&heap->sched_lock);
+        return 0;
+    }
+
+    // Nothing to do until a cycle is running or enough has been allocated to start one
+    size_t allocated = __atomic_load_n(&heap->gc_bytes_allocated, __ATOMIC_RELAXED) - heap->gc_bytes_at_cycle_end;
+    if (heap->gc_phase == GC_PHASE_IDLE && allocated < heap->sched_config.trigger_bytes) {
+        pthread_mutex_unlock(&heap->sched_lock);
+        return 0;
+    }
+
+    // Fit the quantum into the GC budget of every window ending inside it. Moving a
+    // window's end later adds at least as much quantum as it drops history, so the
+    // one ending with the quantum is the fullest - but a shorter quantum moves that
+    // window back over more history. The length is found as a fixed point instead,
+    // starting from what the window ending now leaves: every step fits the budget
+    // and only grows, and a few steps settle. Quanta are recorded as they ran, so an
+    // overrun past a deadline comes out of the budgets of the quanta after it.
+    uint64_t now = tb_now_ns();
+    uint64_t window = heap->sched_config.window_ns;
+    uint64_t budget = (uint64_t)((1.0 - heap->sched_config.target_mmu) * (double)window);
+    uint64_t quantum = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t from = now + quantum > window ? now + quantum - window : 0;
+        uint64_t used = sched_gc_time(from, now);
+        uint64_t available = budget > used ? budget - used : 0;
+        if (available > heap->sched_config.quantum_ns) available = heap->sched_config.quantum_ns;
+        if (available <= quantum) break;
+        quantum = available;
+    }
+
+    // Slivers cost more in switching than they get done
+    if (quantum < heap->sched_config.quantum_ns / 4) {
+        heap->sched_stats.deferred++;
+        pthread_mutex_unlock(&heap->sched_lock);
+        return 0;
+    }
+
+    gc_budget_t slice = { now + quantum, SIZE_MAX, 0 };
+    if (run_slice(&slice, 0) == GC_CYCLE_COMPLETE) {
+        heap->sched_stats.cycles++;
+    }
+    sched_record(now, tb_now_ns());
+    pthread_mutex_unlock(&heap->sched_lock);
+    return 1;
+}
+
+void gc_scheduler_get_stats(gc_scheduler_stats_t *stats) {
+    if (!stats) return;
+
+    lock_parked(&heap->sched_lock);
+    *stats = heap->sched_stats;
+    pthread_mutex_unlock(&heap->sched_lock);
+}
+
+/* ========================= ALLOCATION PACING ========================= */
+
+void gc_pacing_start(const gc_pacing_config_t *config) {
+    gc_pacing_config_t defaults = {
+        .step_bytes = TLAB_CHUNK_SIZE,
+        .trigger_occupancy = 0.5,
+        .reserve = 0.1,
+    };
+    if (!config) config = &defaults;
+
+    lock_parked(&heap->pace_lock);
+    heap->pace_config = *config;
+    if (heap->pace_config.trigger_occupancy < 0.0) heap->pace_config.trigger_occupancy = 0.0;
+    if (heap->pace_config.reserve < 0.0) heap->pace_config.reserve = 0.0;
+    if (heap->pace_config.reserve > 1.0) heap->pace_config.reserve = 1.0;
+
+    memset(&heap->pace_stats, 0, sizeof(heap->pace_stats));
+    heap->pace_stats.min_free_bytes = tb_allocator_capacity(heap->allocator);
+    heap->pace_last_bytes = __atomic_load_n(&heap->gc_bytes_allocated, __ATOMIC_RELAXED);
+    __atomic_store_n(&heap->pace_enabled, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&heap->pace_lock);
+}
+
+void gc_pacing_stop(void) {
+    lock_parked(&heap->pace_lock);
+    __atomic_store_n(&heap->pace_enabled, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&heap->pace_lock);
+}
+
+// Work units the cycle in flight still needs, estimated from the last cycle: its
+// marking touched about as many objects as are live now and its sweep visited
+// the rest of the heap. Before any cycle has completed, every granule of the
+// heap is assumed to start an object - an overestimate, so the first cycle
+// paces too fast rather than too slow. A cycle that outruns its estimate is
+// assumed to be only half done.
+static size_t pace_remaining_work(size_t heap_bytes) {
+    size_t estimate = heap->last_cycle_work ? heap->last_cycle_work : heap_bytes / GC_GRANULE;
+    if (estimate > heap->cycle_work) return estimate - heap->cycle_work;
+    return heap->cycle_work > GC_SLICE_CHECK ? heap->cycle_work : GC_SLICE_CHECK;
+}
+
+// Baker-style pacing: once the heap is full enough to start a cycle, every
+// step_bytes of allocation pays for a share of the cycle's remaining work in
+// proportion to the share of the remaining headroom it used up. The headroom is
+// the free heap minus the reserve, so the cycle finishes before the reserve is
+// touched; with no headroom left the cycle is finished outright.
+static void pace_allocation(void) {
+    if (!__atomic_load_n(&heap->pace_enabled, __ATOMIC_ACQUIRE) || heap->gc_mode != GC_MODE_MARK_SWEEP) return;
+
+    size_t allocated = __atomic_load_n(&heap->gc_bytes_allocated, __ATOMIC_RELAXED);
+    if (allocated - heap->pace_last_bytes < heap->pace_config.step_bytes) return;
+    if (pthread_mutex_trylock(&heap->pace_lock) != 0) return;
+
+    size_t bytes = allocated - heap->pace_last_bytes;
+    size_t heap_bytes = __atomic_load_n(&heap->gc_heap_bytes, __ATOMIC_RELAXED);
+    size_t capacity = tb_allocator_capacity(heap->allocator);
+    if (heap->gc_phase == GC_PHASE_IDLE && heap_bytes < heap->pace_config.trigger_occupancy * capacity) {
+        heap->pace_last_bytes = allocated;
+        pthread_mutex_unlock(&heap->pace_lock);
+        return;
+    }
+    heap->pace_last_bytes = allocated;
+
+    size_t reserve = (size_t)(heap->pace_config.reserve * capacity);
+    size_t free_bytes = heap_bytes < capacity ? capacity - heap_bytes : 0;
+    size_t headroom = free_bytes > reserve ? free_bytes - reserve : 0;
+    size_t remaining = pace_remaining_work(heap_bytes);
+
+    size_t work = SIZE_MAX;
+    if (headroom > bytes) {
+        work = (size_t)((double)remaining * (double)bytes / (double)headroom) + 1;
+    }
+
+    gc_budget_t budget = { UINT64_MAX, work, 0 };
+    int completed = run_slice(&budget, 0) == GC_CYCLE_COMPLETE;
+
+    heap->pace_stats.steps++;
+    heap->pace_stats.work += work - budget.work;
+    if (completed) {
+        heap->pace_stats.cycles++;
+        if (free_bytes < heap->pace_stats.min_free_bytes) heap->pace_stats.min_free_bytes = free_bytes;
+    }
+    pthread_mutex_unlock(&heap->pace_lock);
+}
+
+void gc_pacing_get_stats(gc_pacing_stats_t *stats) {
+    if (!stats) return;
+
+    lock_parked(&heap->pace_lock);
+    *stats = heap->pace_stats;
+    pthread_mutex_unlock(&heap->pace_lock);
+}
+
+/* ========================= AUTOMATIC COLLECTION ========================= */
+
+// Allocation-threshold trigger: a full collection once the chunks in use reach the
+// heap goal. The scheduler and pacing start their own cycles, so this stays out of
+// their way; semispace collections are triggered by a full space instead.
+static void auto_collect(void) {
+    if (!heap->heap_policy.auto_collect || heap->gc_mode != GC_MODE_MARK_SWEEP) return;
+    if (__atomic_load_n(&heap->sched_enabled, __ATOMIC_ACQUIRE) || __atomic_load_n(&heap->pace_enabled, __ATOMIC_ACQUIRE)) return;
+    if (__atomic_load_n(&heap->gc_heap_bytes, __ATOMIC_RELAXED) < heap->heap_goal) return;
+
+    collect_automatic();
+    __atomic_fetch_add(&heap->gc_stats.triggered_collections, 1, __ATOMIC_RELAXED);
+}
+
+static void collect_automatic(void) {
+    gc_budget_t budget = unlimited_budget;
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->cycle_automatic = 1;
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    run_slice(&budget, 1);
+
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->cycle_automatic = 0;
+    pthread_mutex_unlock(&heap->gc_lock);
+}
+
+void gc_set_heap_policy(const gc_heap_policy_t *policy) {
+    if (!policy) policy = &default_heap_policy;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->heap_policy = *policy;
+    if (heap->heap_policy.target_live_ratio > 1.0) heap->heap_policy.target_live_ratio = 1.0;
+    if (heap->heap_policy.max_heap_bytes < HEAP_SIZE) heap->heap_policy.max_heap_bytes = HEAP_SIZE;
+    pthread_mutex_unlock(&heap->gc_lock);
+}
+
+/* ========================= PREEMPTION ========================= */
+
+void gc_set_preemption(const gc_preemption_config_t *config) {
+    pthread_mutex_lock(&heap->gc_lock);
+    if (config) {
+        heap->preemption = *config;
+        if (!heap->preemption.check_interval) heap->preemption.check_interval = GC_PREEMPT_INTERVAL;
+        if (!heap->preemption.max_wait_ns) heap->preemption.max_wait_ns = GC_PREEMPT_MAX_WAIT_NS;
+    } else {
+        memset(&heap->preemption, 0, sizeof(heap->preemption));
+        heap->preemption.check_interval = GC_PREEMPT_INTERVAL;
+    }
+    heap->preempt_interval = heap->preemption.check_interval;
+    pthread_mutex_unlock(&heap->gc_lock);
+}
+
+void gc_set_prefetch_distance(size_t distance) {
+    pthread_mutex_lock(&heap->gc_lock);
+    heap->prefetch_distance = distance < GC_PREFETCH_MAX ? distance : GC_PREFETCH_MAX - 1;
+    pthread_mutex_unlock(&heap->gc_lock);
+}
+
+void gc_get_stats(gc_stats_t *stats) {
+    if (!stats) return;
+
+    pthread_mutex_lock(&heap->gc_lock);
+    *stats = heap->gc_stats;
+    stats->pause_p50_ns = tb_histogram_percentile(&heap->pause_histogram, 0.50);
+    stats->pause_p99_ns = tb_histogram_percentile(&heap->pause_histogram, 0.99);
+    stats->pause_p999_ns = tb_histogram_percentile(&heap->pause_histogram, 0.999);
+    stats->pause_max_ns = heap->pause_histogram.max;
+    stats->heap_bytes = __atomic_load_n(&heap->gc_heap_bytes, __ATOMIC_RELAXED);
+    stats->heap_goal_bytes = heap->heap_goal;
+    stats->heap_capacity_bytes = tb_allocator_capacity(heap->allocator);
+    pthread_mutex_unlock(&heap->gc_lock);
+
+    pthread_mutex_lock(&los_lock);
+    stats->large_cache_bytes = los_cache_bytes;
+    pthread_mutex_unlock(&los_lock);
+}
+
+void gc_reset_stats(void) {
+    pthread_mutex_lock(&heap->gc_lock);
+    memset(&heap->gc_stats, 0, sizeof(heap->gc_stats));
+    memset(&heap->pause_histogram, 0, sizeof(heap->pause_histogram));
+    pthread_mutex_unlock(&heap->gc_lock);
+}
+
+int findObj(object_t *ptr) {
+    if (heap->gc_mode == GC_MODE_SEMISPACE) {
+        uint8_t *curr = heap->ss_active;
+        while (curr < heap->ss_alloc_ptr) {
+            object_t *obj = (object_t *)curr;
+            if (obj == ptr) return 1;
+            curr += ss_align(obj_extent(obj));
+        }
+        return 0;
+    }
+
+    return ptr && is_tracked_object(ptr);
+}
+
+/* ========================= HEAPS ========================= */
+
+// Switches the calling thread to h, or to the default heap for NULL, and returns the
+// heap it was using so the caller can switch back.
+static gc_heap_t *heap_enter(gc_heap_t *h) {
+    gc_heap_t *saved = heap;
+    if (!h) h = &default_heap;
+    if (h != saved) heap_switch(h);
+    return saved;
+}
+
+static void heap_leave(gc_heap_t *saved) {
+    if (saved != heap) heap_switch(saved);
+}
+
+gc_heap_t *gc_default_heap(void) {
+    return &default_heap;
+}
+
+gc_heap_t *gc_heap_create(void) {
+    gc_heap_t *h = calloc(1, sizeof(gc_heap_t));
+    if (!h) return NULL;
+    h->allocator = tb_allocator_create();
+    if (!h->allocator) {
+        free(h);
+        return NULL;
+    }
+
+    pthread_mutex_init(&h->gc_lock, NULL);
+    pthread_cond_init(&h->stop_cond, NULL);
+    pthread_cond_init(&h->resume_cond, NULL);
+    pthread_mutex_init(&h->sched_lock, NULL);
+    pthread_mutex_init(&h->pace_lock, NULL);
+    pthread_mutex_init(&h->finalizer_lock, NULL);
+    pthread_cond_init(&h->finalizer_cond, NULL);
+    h->prefetch_distance = GC_PREFETCH_DISTANCE;
+    h->heap_policy = default_heap_policy;
+    h->heap_goal = HEAP_SIZE / 2;
+    h->preempt_interval = GC_PREEMPT_INTERVAL;
+
+    gc_heap_t *saved = heap_enter(h);
+    gc_init();
+    heap_leave(saved);
+
+    pthread_mutex_lock(&heaps_lock);
+    h->next = gc_heaps;
+    gc_heaps = h;
+    __atomic_fetch_add(&gc_heap_count, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&heaps_lock);
+    return h;
+}
+
+void gc_heap_destroy(gc_heap_t *h) {
+    if (!h || h == &default_heap) return;
+
+    gc_heap_t *saved = heap_enter(h);
+    gc_thread_t *own = current_thread;
+    gc_finalizer_thread_stop();
+
+    // Once unlinked, exiting threads and the barrier no longer reach the heap
+    pthread_mutex_lock(&heaps_lock);
+    gc_heap_t **pp = &gc_heaps;
+    while (*pp != h) {
+        pp = &(*pp)->next;
+    }
+    *pp = h->next;
+    __atomic_fetch_sub(&gc_heap_count, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&h->gc_lock);
+    for (gc_thread_t *thread = h->gc_threads; thread; thread = thread->next) {
+        thread->heap = NULL;
+    }
+    h->gc_threads = NULL;
+    set_barrier_active(0);
+    for (gc_ephemeron_table_t *table = h->ephemeron_tables; table; table = table->next) {
+        table->heap = NULL;
+    }
+    pthread_mutex_unlock(&h->gc_lock);
+    pthread_mutex_unlock(&heaps_lock);
+
+    while (h->los_objects) {
+        los_chunk_free((gc_chunk_t *)(h->los_objects + 1));
+    }
+    // Mappings the heap retired outlive it in the cache and the unmap queue
+    pthread_mutex_lock(&los_lock);
+    for (los_mapping_t *m = los_cache; m; m = m->next) {
+        if (m->heap == h) m->heap = NULL;
+    }
+    for (los_mapping_t *m = los_unmap_queue; m; m = m->next) {
+        if (m->heap == h) m->heap = NULL;
+    }
+    if (los_unmapping_heap == h) los_unmapping_heap = NULL;
+    pthread_mutex_unlock(&los_lock);
+    if (h->ss_active) munmap(h->ss_active, SEMISPACE_SIZE);
+    if (h->ss_reserve) munmap(h->ss_reserve, SEMISPACE_SIZE);
+    free(h->weak_objects);
+    free_finalizable_list(h->finalizable);
+    free_finalizable_list(h->finalize_queue);
+    free_finalizable_list(h->finalizing);
+
+    // Other threads' states for the heap are freed when they exit; ours goes now
+    if (own) {
+        gc_thread_t **link = &thread_states;
+        while (*link != own) {
+            link = &(*link)->sibling;
+        }
+        *link = own->sibling;
+        pthread_setspecific(gc_thread_key, thread_states);
+        gc_thread_release(own);
+        current_thread = NULL;
+    }
+
+    heap_leave(saved == h ? &default_heap : saved);
+    tb_allocator_destroy(h->allocator);
+    pthread_mutex_destroy(&h->gc_lock);
+    pthread_cond_destroy(&h->stop_cond);
+    pthread_cond_destroy(&h->resume_cond);
+    pthread_mutex_destroy(&h->sched_lock);
+    pthread_mutex_destroy(&h->pace_lock);
+    pthread_mutex_destroy(&h->finalizer_lock);
+    pthread_cond_destroy(&h->finalizer_cond);
+    free(h);
+}
+
+gc_heap_t *gc_heap_use(gc_heap_t *h) {
+    return heap_enter(h);
+}
+
+void *gc_heap_alloc(gc_heap_t *h, size_t size, size_t child_slots) {
+    gc_heap_t *saved = heap_enter(h);
+    void *data = gc_alloc(size, child_slots);
+    heap_leave(saved);
+    return data;
+}
+
+void gc_heap_add_root(gc_heap_t *h, object_t *obj) {
+    gc_heap_t *saved = heap_enter(h);
+    gc_add_root(obj);
+    heap_leave(saved);
+}
+
+void gc_heap_remove_root(gc_heap_t *h, object_t *obj) {
+    gc_heap_t *saved = heap_enter(h);
+    gc_remove_root(obj);
+    heap_leave(saved);
+}
+
+void gc_heap_collect(gc_heap_t *h) {
+    gc_heap_t *saved = heap_enter(h);
+    gc_collect_full();
+    heap_leave(saved);
+}
+
+void gc_heap_get_stats(gc_heap_t *h, gc_stats_t *stats) {
+    gc_heap_t *saved = heap_enter(h);
+    gc_get_stats(stats);
+    heap_leave(saved);
+}
+
+/* ========================= OBJECT ACCESSORS ========================= */
+
+object_t *gc_object_of(void *data) {
+    return data ? (object_t *)data - 1 : NULL;
+}
+
+void *gc_object_data(object_t *obj) {
+    return obj ? obj_data(obj) : NULL;
+}
+
+size_t gc_object_size(object_t *obj) {
+    return obj ? obj_size(obj) : 0;
+}
+
+size_t gc_object_child_count(object_t *obj) {
+    return obj ? obj_slot_count(obj) : 0;
+}
+
+object_t **gc_object_children(object_t *obj) {
+    return (obj && !(obj->header & GC_TYPED)) ? obj_children(obj) : NULL;
+}
+
+object_t *gc_get_child(object_t *obj, size_t slot) {
+    if (!obj || slot >= obj_slot_count(obj)) return NULL;
+    return *obj_slot(obj, slot);
+}
@@ -2,6 +2,7 @@
 #define TB_GC_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,20 +11,408 @@ extern "C" {
 // Forward declare object type
 typedef struct object object_t;
 
+// An independent heap with its own allocator, roots and collector; see gc_heap_create
+typedef struct gc_heap gc_heap_t;
+
+// Hash table whose entries live only as long as their keys; see gc_ephemeron_table_create
+typedef struct gc_ephemeron_table gc_ephemeron_table_t;
+
+// Called with the user data of a finalizable object that became unreachable
+typedef void (*gc_finalizer_t)(void *data);
+
+// Identifies a layout registered with gc_register_type
+typedef uint32_t gc_type_id_t;
+#define GC_TYPE_INVALID ((gc_type_id_t)-1)
+
+/**
+ * Collector statistics since initialization or the last gc_reset_stats.
+ * Times are in nanoseconds. In semispace mode, objects and bytes marked
+ * count survivors copied, and the sweep phase is always zero.
+ */
+typedef struct {
+    uint64_t collections;        // Completed collection cycles
+
+    uint64_t root_scan_ns;       // Cumulative time per phase
+    uint64_t mark_ns;
+    uint64_t sweep_ns;
+    uint64_t last_root_scan_ns;  // Phase times of the most recent cycle
+    uint64_t last_mark_ns;
+    uint64_t last_sweep_ns;
+
+    uint64_t objects_marked;     // Cumulative object and byte counts
+    uint64_t bytes_marked;
+    uint64_t objects_freed;
+    uint64_t bytes_freed;
+
+    uint64_t pause_count;        // Pauses: one per gc_collect_full, step or scheduler quantum
+    uint64_t pause_total_ns;
+    uint64_t pause_p50_ns;       // From a log-bucketed histogram, within 25%
+    uint64_t pause_p99_ns;
+    uint64_t pause_p999_ns;
+    uint64_t pause_max_ns;       // Exact
+
+    uint64_t triggered_collections;  // Started because the heap reached its goal
+    uint64_t failure_collections;    // Started because an allocation failed
+    uint64_t heap_grows;             // Arenas added to meet the heap goal
+    size_t heap_bytes;               // Held by the collector's chunks right now
+    size_t heap_goal_bytes;          // Footprint that triggers the next collection
+    size_t heap_capacity_bytes;      // Size of the allocator's heap
+
+    uint64_t preemptions;        // Slices ended or skipped for a critical event
+    uint64_t max_poll_gap_ns;    // Longest collector work between two preemption polls
+
+    uint64_t weak_refs_cleared;  // Weak slots cleared because their target died
+    uint64_t ephemerons_removed; // Ephemeron entries removed because their key died
+
+    uint64_t finalizers_queued;  // Finalizable objects found unreachable
+    uint64_t finalizers_run;     // ... whose finalizer has returned
+
+    uint64_t large_objects;         // Objects given a mapping of their own
+    uint64_t large_cache_hits;      // ... that reused a cached mapping instead of calling mmap
+    uint64_t large_bytes_unmapped;  // Returned to the OS by the unmapper thread
+    size_t large_cache_bytes;       // Freed mappings cached for reuse right now
+    uint64_t cards_rescanned;       // Large-array chunks rescanned because the barrier dirtied them
+
+    uint64_t region_bytes_released; // Region chunks freed whole when their region ended
+    uint64_t region_bytes_promoted; // ... handed to the heap instead because objects in them escaped
+} gc_stats_t;
+
+/**
+ * Automatic collection and heap sizing policy. After every cycle the heap
+ * goal is set to live / target_live_ratio, stretched (at most 2x) when the
+ * collector took more than target_gc_ratio of the time since the previous
+ * cycle, or shrunk (to at most half) when it took less.
+ */
+typedef struct {
+    int auto_collect;          // Collect at the heap goal and when an allocation fails
+    double target_gc_ratio;    // Share of time the collector may take, e.g. 0.05
+    double target_live_ratio;  // Live bytes / heap goal just after a collection, e.g. 0.5
+    size_t max_heap_bytes;     // The heap is never grown beyond this
+} gc_heap_policy_t;
+
+/**
+ * Time-based scheduler settings. GC work runs in quanta of at most quantum_ns,
+ * placed so that every window of window_ns leaves the mutator at least
+ * target_mmu of the time.
+ */
+typedef struct {
+    uint64_t window_ns;     // MMU window, e.g. 10 ms
+    double target_mmu;      // Minimum mutator share of any window, 0.0 - 1.0
+    uint64_t quantum_ns;    // Longest quantum; clamped to the window's GC budget
+    size_t trigger_bytes;   // Allocation since the last cycle that starts a new one; 0 runs back to back
+} gc_scheduler_config_t;
+
+typedef struct {
+    uint64_t quanta;          // Quanta run
+    uint64_t cycles;          // Cycles completed by the scheduler
+    uint64_t deferred;        // Polls that found work but no budget left in the window
+    uint64_t gc_ns;           // Total time spent in quanta
+    uint64_t max_quantum_ns;  // Longest quantum; the end of marking cannot be split
+    double mmu;               // Lowest mutator utilization over any window so far
+} gc_scheduler_stats_t;
+
+/**
+ * Allocation pacing settings. Work is measured in objects scanned or swept.
+ */
+typedef struct {
+    size_t step_bytes;         // Allocation between paced steps; checked at each chunk refill
+    double trigger_occupancy;  // Fraction of the heap held by GC chunks that starts a cycle
+    double reserve;            // Fraction of the heap meant to be still free when a cycle ends
+} gc_pacing_config_t;
+
+typedef struct {
+    uint64_t steps;            // Paced steps taken
+    uint64_t cycles;           // Cycles completed by paced steps
+    uint64_t work;             // Objects scanned or swept by paced steps
+    size_t min_free_bytes;     // Least free heap seen at a step that completed a cycle
+} gc_pacing_stats_t;
+
+/**
+ * Outcome of a slice of collector work.
+ */
+typedef enum {
+    GC_CYCLE_COMPLETE = 0, // The slice finished a collection cycle
+    GC_YIELD_BUDGET,       // The slice's work or time ran out; the cycle continues later
+    GC_YIELD_CRITICAL      // A critical event preempted the slice; the cycle continues later
+} gc_status_t;
+
+/**
+ * Preemption hooks. The collector polls critical_event_pending every
+ * check_interval objects scanned or swept - fewer when that much work takes
+ * longer than half of max_wait_ns - and stops at the next consistent point
+ * when it returns non-zero. Both hooks are called from whichever thread is
+ * collecting; critical_event_pending is called with the collector's lock held
+ * and must not allocate.
+ */
+typedef struct {
+    int (*critical_event_pending)(void *arg);
+    void (*emergency_yield)(void *arg);  // Runs the event when the collection cannot return; may allocate
+    void *arg;
+    size_t check_interval;               // Objects between polls; 0 for 64
+    uint64_t max_wait_ns;                // Bound on collector work between polls; 0 for 100 us
+} gc_preemption_config_t;
+
+/**
+ * Collection strategies selectable at initialization.
+ */
+typedef enum {
+    GC_MODE_MARK_SWEEP = 0, // Non-moving mark and sweep over the buddy heap.
+    GC_MODE_SEMISPACE       // Cheney copying collector over two bump-allocated semispaces.
+} gc_mode_t;
+
 /**
  * Initializes the garbage collector and allocator.
+ * Equivalent to gc_init_mode(GC_MODE_MARK_SWEEP).
  */
 void gc_init(void);
 
+/**
+ * Initializes the garbage collector with the given collection strategy.
+ *
+ * In GC_MODE_SEMISPACE objects move on every collection. Entries in the
+ * root set are updated in place; any other object pointer held by the
+ * caller must be refreshed with gc_forward() after a collection.
+ *
+ * @param mode Collection strategy to use until the next gc_init call.
+ */
+void gc_init_mode(gc_mode_t mode);
+
+/**
+ * Returns the current address of an object after a copying collection.
+ *
+ * Only meaningful in GC_MODE_SEMISPACE and only for pointers obtained
+ * before the most recent collection. In mark-sweep mode objects never
+ * move and obj is returned unchanged.
+ *
+ * @param obj Pointer to an object as seen before the last collection.
+ * @return    The object's new address, or NULL if it did not survive.
+ */
+object_t *gc_forward(object_t *obj);
+
+/**
+ * Heaps. Each heap has its own allocator, roots, statistics and collector, so
+ * collecting one never pauses or scans another. Every call in this header acts
+ * on the calling thread's current heap, which starts out as the default heap;
+ * gc_heap_use switches it, and the gc_heap_* calls below act on a given heap
+ * without switching. Objects must only reference objects of their own heap.
+ * Type descriptors and the large-object mapping cache are shared.
+ */
+
+/**
+ * Returns the heap every thread starts on.
+ */
+gc_heap_t *gc_default_heap(void);
+
+/**
+ * Creates an empty mark-sweep heap with the default heap policy.
+ *
+ * @return The new heap, or NULL if its memory could not be reserved.
+ */
+gc_heap_t *gc_heap_create(void);
+
+/**
+ * Frees a heap together with every object in it. No other thread may be using
+ * the heap; a caller whose current heap it is goes back to the default heap.
+ * Ephemeron tables created in the heap become empty and must still be destroyed.
+ *
+ * @param h Heap to destroy. The default heap cannot be destroyed and is ignored.
+ */
+void gc_heap_destroy(gc_heap_t *h);
+
+/**
+ * Makes h the calling thread's current heap. Roots pushed on the shadow stack
+ * and open regions belong to the heap that was current at the time.
+ *
+ * @param h Heap to use, or NULL for the default heap.
+ * @return  The heap that was current before.
+ */
+gc_heap_t *gc_heap_use(gc_heap_t *h);
+
+/**
+ * gc_alloc, gc_add_root, gc_remove_root, gc_collect_full and gc_get_stats
+ * against h rather than the current heap; NULL means the default heap.
+ */
+void *gc_heap_alloc(gc_heap_t *h, size_t size, size_t child_slots);
+void gc_heap_add_root(gc_heap_t *h, object_t *obj);
+void gc_heap_remove_root(gc_heap_t *h, object_t *obj);
+void gc_heap_collect(gc_heap_t *h);
+void gc_heap_get_stats(gc_heap_t *h, gc_stats_t *stats);
+
 /**
  * Allocates memory managed by the GC.
  *
+ * In mark-sweep mode objects of 32 KB or more live in the large-object space,
+ * each in a mapping of its own that is cached for reuse once the object dies.
+ *
  * @param size         Number of bytes for user data.
  * @param child_slots  Number of child references the object can hold.
  * @return             Pointer to user data area.
  */
 void *gc_alloc(size_t size, size_t child_slots);
 
+/**
+ * Registers an object layout whose pointers are interleaved with plain data.
+ *
+ * Objects of the type carry only the type id in their header; the marker
+ * finds their pointer fields through the registered map, using a bitmap
+ * when every pointer lies in the first 64 words and an offset list
+ * otherwise. Pointer fields hold object_t pointers, are zeroed on
+ * allocation, and are addressed by gc_write_barrier in ascending offset
+ * order.
+ *
+ * @param size        Size of the object's data in bytes.
+ * @param ptr_offsets Byte offsets of the pointer fields; each pointer aligned.
+ * @param ptr_count   Number of entries in ptr_offsets.
+ * @return            The new type id, or GC_TYPE_INVALID.
+ */
+gc_type_id_t gc_register_type(size_t size, const size_t *ptr_offsets, size_t ptr_count);
+
+/**
+ * Registers a layout whose pointer fields all lie in the first 64 words,
+ * given as the bitmap the marker scans: bit i set when word i of the data
+ * holds a pointer. Nothing is derived at registration beyond the offsets
+ * that address slots by index.
+ *
+ * @param size       Size of the object's data in bytes.
+ * @param ptr_bitmap One bit per pointer-sized word of the data.
+ * @return           The new type id, or GC_TYPE_INVALID.
+ */
+gc_type_id_t gc_register_type_bitmap(size_t size, uint64_t ptr_bitmap);
+
+/**
+ * Allocates a GC-managed object of a registered type.
+ *
+ * @param type_id Id returned by gc_register_type.
+ * @return        Pointer to the zeroed user data area.
+ */
+void *gc_alloc_typed(gc_type_id_t type_id);
+
+/**
+ * Allocates an object whose child slots are weak references.
+ *
+ * The slots are written with gc_write_barrier and read with gc_get_child
+ * like any others, but they do not keep their targets alive: once marking
+ * finds a target unreachable, the slot is cleared before the target is
+ * freed. In semispace mode surviving targets are updated when they move.
+ *
+ * @param size       Number of bytes for user data.
+ * @param weak_slots Number of weak references the object can hold.
+ * @return           Pointer to user data area.
+ */
+void *gc_alloc_weak(size_t size, size_t weak_slots);
+
+/**
+ * Allocates an object with a finalizer, for releasing external resources.
+ *
+ * When a collection finds the object unreachable it keeps the object, and
+ * everything it refers to, alive and queues it instead of freeing it. The
+ * finalizer runs later, outside the collector's pause, from
+ * gc_run_finalizers or the finalizer thread; the object is freed by the
+ * first collection after that to find it unreachable again. Each finalizer
+ * runs at most once. Weak references to a queued object are not cleared
+ * until it is freed. In semispace mode finalizers must not run while
+ * another thread collects, since the object may move.
+ *
+ * @param size        Number of bytes for user data.
+ * @param child_slots Number of child references the object can hold.
+ * @param finalizer   Called with the object's user data; may allocate.
+ * @return            Pointer to user data area.
+ */
+void *gc_alloc_finalizable(size_t size, size_t child_slots, gc_finalizer_t finalizer);
+
+/**
+ * Runs every queued finalizer on the calling thread, in batches that each
+ * take the collector's lock only to dequeue and to retire the batch.
+ * Finalizers must not call this themselves.
+ *
+ * @return The number of finalizers run.
+ */
+size_t gc_run_finalizers(void);
+
+/**
+ * Starts a background thread that runs finalizers as collections queue them.
+ *
+ * @return 1 if the thread is running, 0 if it could not be created.
+ */
+int gc_finalizer_thread_start(void);
+
+/**
+ * Stops the finalizer thread after its current batch. Finalizers still
+ * queued are left for gc_run_finalizers or the next thread started.
+ */
+void gc_finalizer_thread_stop(void);
+
+/**
+ * Creates an ephemeron table: a map from objects to objects in which an
+ * entry keeps its value alive only while the key is reachable from outside
+ * the table, even if the value itself refers back to the key. Entries whose
+ * key dies are removed by the collection that finds it dead, which makes the
+ * table suitable for memo caches keyed by the objects they describe. Keys
+ * are compared by address and, in semispace mode, updated when they move.
+ *
+ * @return The new, empty table, or NULL if out of memory.
+ */
+gc_ephemeron_table_t *gc_ephemeron_table_create(void);
+
+/**
+ * Removes the table from the collector and frees it. Its values are no longer kept alive.
+ */
+void gc_ephemeron_table_destroy(gc_ephemeron_table_t *table);
+
+/**
+ * Maps key to value, replacing any value already stored for key.
+ *
+ * @return 1 on success, 0 if key is NULL or the table could not grow.
+ */
+int gc_ephemeron_table_put(gc_ephemeron_table_t *table, object_t *key, object_t *value);
+
+/**
+ * Returns the value stored for key, or NULL if there is none.
+ */
+object_t *gc_ephemeron_table_get(gc_ephemeron_table_t *table, object_t *key);
+
+/**
+ * Removes the entry for key. Returns 1 if there was one.
+ */
+int gc_ephemeron_table_remove(gc_ephemeron_table_t *table, object_t *key);
+
+/**
+ * Returns the number of entries in the table.
+ */
+size_t gc_ephemeron_table_count(gc_ephemeron_table_t *table);
+
+/**
+ * Returns the object header for a user data pointer returned by gc_alloc.
+ */
+object_t *gc_object_of(void *data);
+
+/**
+ * Returns the user data area of an object, as originally returned by gc_alloc.
+ */
+void *gc_object_data(object_t *obj);
+
+/**
+ * Returns the usable size of an object's user data, rounded up to a pointer.
+ */
+size_t gc_object_size(object_t *obj);
+
+/**
+ * Returns the number of child slots an object was allocated with, or the
+ * number of pointer fields of a typed object.
+ */
+size_t gc_object_child_count(object_t *obj);
+
+/**
+ * Returns an object's child slot array, or NULL for typed objects. Stores
+ * into it must go through gc_write_barrier.
+ */
+object_t **gc_object_children(object_t *obj);
+
+/**
+ * Returns the child in the given slot, or NULL if the slot is empty or out of range.
+ */
+object_t *gc_get_child(object_t *obj, size_t slot);
+
 /**
  * Adds an object to the root set.
  *
@@ -39,6 +428,73 @@ void gc_add_root(object_t *obj);
 void gc_remove_root(object_t *obj);
 int findObj(object_t *obj);
 
+/**
+ * Registers a local root on the calling thread's shadow stack.
+ *
+ * The collector reads *slot at collection time, so the variable may be
+ * reassigned freely while it is pushed; in semispace mode it is also
+ * rewritten when the object moves. Pushing takes no locks after the
+ * thread's first call and the stack grows without a fixed limit.
+ *
+ * @param slot Address of a variable holding an object pointer (or NULL).
+ */
+void gc_push_root(object_t **slot);
+
+/**
+ * Enables or disables conservative scanning of thread stacks and registers.
+ *
+ * When enabled, mark-sweep collections treat every word on the stacks of
+ * threads registered with gc_register_thread as a potential root, so
+ * locals need no gc_add_root or gc_push_root. Any word pointing into a live
+ * object keeps it alive. Semispace collections ignore this setting since
+ * conservatively referenced objects cannot be moved.
+ *
+ * @param enabled Non-zero to scan stacks at the start of each mark phase.
+ */
+void gc_set_conservative_roots(int enabled);
+
+/**
+ * Records the calling thread's stack bounds for conservative root scanning.
+ * Call once per thread, from the thread itself.
+ */
+void gc_register_thread(void);
+
+/**
+ * Saves the calling thread's registers and stack pointer and stops it for the
+ * collector.
+ *
+ * The final root scan of each cycle waits until every other thread of the heap
+ * that holds shadow stack roots or called gc_register_thread is stopped, and
+ * scans their stacks from the state they saved; threads with neither are never
+ * waited for. A thread counts as stopped from gc_safepoint until its next call
+ * into the collector - allocating, pushing or popping a root, or a barriered
+ * store that must shade - and must not store object pointers in between.
+ * Allocation polls for a pending stop, so a thread holding roots calls it
+ * periodically in long loops that make no such calls, and brackets anything
+ * that may block with gc_blocking_begin and gc_blocking_end, or a collection on
+ * another thread waits for it.
+ */
+void gc_safepoint(void);
+
+/**
+ * Counts the calling thread as stopped until gc_blocking_end, for a wait on a
+ * lock, condition variable or I/O that may outlast a collection on another
+ * thread. In between the thread must not touch GC objects or its roots.
+ */
+void gc_blocking_begin(void);
+
+/**
+ * Ends a blocking region, first waiting out a stop in progress.
+ */
+void gc_blocking_end(void);
+
+/**
+ * Drops the n most recently pushed shadow stack roots of the calling thread.
+ *
+ * @param n Number of slots to pop.
+ */
+void gc_pop_roots(size_t n);
+
 /**
  * Performs a full garbage collection (mark and sweep).
  */
@@ -46,18 +502,232 @@ void gc_collect_full(void);
 
 /**
  * Performs one step of incremental garbage collection.
+ *
+ * Starts a cycle if none is in flight and advances it by a fixed amount of
+ * work: a few thousand objects scanned or swept. Marking is incremental: objects allocated meanwhile are born
+ * marked, gc_write_barrier shades stored pointers, and the roots are scanned
+ * again before sweeping. In semispace mode each step is a whole collection.
+ *
+ * @return 1 if the step completed a collection cycle, 0 otherwise.
+ */
+int gc_collect_step(void);
+
+/**
+ * Runs the cycle in flight, or a new one, until it completes or a critical
+ * event preempts it. A preempted cycle keeps its marks, mark stack and sweep
+ * position, and the next call of this, gc_collect_step or gc_collect_full
+ * resumes it. In semispace mode a collection cannot be preempted once started.
+ *
+ * @return GC_CYCLE_COMPLETE, or GC_YIELD_CRITICAL if the predicate fired -
+ *         possibly before any work was done.
+ */
+gc_status_t gc_collect_preemptible(void);
+
+/**
+ * Installs the critical-event hooks polled by every mark-sweep slice.
+ *
+ * Steps, scheduler quanta and paced steps return as soon as the predicate
+ * fires, and gc_collect_preemptible reports GC_YIELD_CRITICAL. Collections
+ * that must complete - gc_collect_full and those started by the heap policy -
+ * instead release the collector, call emergency_yield (or yield the CPU if it
+ * is NULL) and resume afterwards. A cycle preempted mid-way may be finished by
+ * another collection started from emergency_yield.
+ *
+ * @param config The hooks, or NULL to remove them.
+ */
+void gc_set_preemption(const gc_preemption_config_t *config);
+
+/**
+ * Starts the time-based (Metronome-style) scheduler.
+ *
+ * Once started, GC work runs in quanta from gc_scheduler_poll, which the
+ * allocator calls whenever it needs a new chunk. Each quantum is shortened or
+ * skipped so the configured minimum mutator utilization holds; the achieved
+ * value is reported by gc_scheduler_get_stats.
+ *
+ * @param config Settings, or NULL for a 10 ms window at 70% MMU with 500 us
+ *               quanta, starting a cycle after a quarter of the heap is allocated.
  */
-void gc_collect_step(void);
+void gc_scheduler_start(const gc_scheduler_config_t *config);
+
+/**
+ * Stops scheduling quanta. A cycle in flight is left for gc_collect_step or
+ * gc_collect_full to finish.
+ */
+void gc_scheduler_stop(void);
+
+/**
+ * Runs a GC quantum if one is due and fits the window's budget.
+ *
+ * Call it from control loops and other points where a short pause is
+ * acceptable; threads that allocate also reach it from the allocator.
+ *
+ * @return 1 if a quantum ran, 0 otherwise.
+ */
+int gc_scheduler_poll(void);
+
+/**
+ * Copies the scheduler's statistics since the last gc_scheduler_start into stats.
+ */
+void gc_scheduler_get_stats(gc_scheduler_stats_t *stats);
+
+/**
+ * Starts allocation-paced (Baker-style) incremental collection.
+ *
+ * Once the heap reaches the trigger occupancy a cycle starts, and every
+ * step_bytes allocated thereafter performs collection work in proportion:
+ * the remaining work of the cycle, estimated from the previous cycle, is spread
+ * over the free heap above the reserve so the cycle finishes before the heap
+ * runs out. Steps run on the allocating thread, like gc_collect_step, and only
+ * in mark-sweep mode.
+ *
+ * @param config Settings, or NULL to step every TLAB chunk, trigger at half the
+ *               heap and keep a 10% reserve.
+ */
+void gc_pacing_start(const gc_pacing_config_t *config);
+
+/**
+ * Stops allocation pacing. A cycle in flight is left for gc_collect_step or
+ * gc_collect_full to finish.
+ */
+void gc_pacing_stop(void);
+
+/**
+ * Copies the pacing statistics since the last gc_pacing_start into stats.
+ */
+void gc_pacing_get_stats(gc_pacing_stats_t *stats);
+
+/**
+ * Replaces the automatic collection policy.
+ *
+ * With auto_collect set (the default) the collector runs a full collection
+ * when its chunks reach the heap goal, unless the scheduler or pacing is
+ * driving collection, and collects and retries - growing the heap up to
+ * max_heap_bytes if that is not enough - when an allocation fails. Either may
+ * happen inside gc_alloc, so every live pointer must be reachable from a root.
+ *
+ * @param policy The new policy, or NULL for the defaults: 5% GC time, a heap
+ *               twice the live size, at most 64 times HEAP_SIZE.
+ */
+void gc_set_heap_policy(const gc_heap_policy_t *policy);
+
+/**
+ * Sets how far ahead the marker prefetches. Each child found while scanning
+ * has its header prefetched and is only inspected after this many further
+ * children have been found, hiding the cache miss behind other work.
+ *
+ * @param distance Children in flight, at most 63; 0 turns prefetching off.
+ *                 The default is 8.
+ */
+void gc_set_prefetch_distance(size_t distance);
+
+/**
+ * Returns every cached large-object mapping to the OS, for example when the
+ * program expects no more large allocations for a while. Freed mappings are
+ * otherwise cached until a whole collection cycle passes without reusing them.
+ * The unmapping itself happens on a background thread.
+ */
+void gc_release_large_cache(void);
+
+/**
+ * Opens an allocation region on the calling thread. Until the matching
+ * gc_region_end, small objects from gc_alloc and gc_alloc_typed are
+ * bump-allocated from chunks belonging to the region, and the collector treats
+ * them all as live. Regions nest; gc_region_end closes the innermost one. Only
+ * the mark-sweep collector uses regions; in semispace mode objects are
+ * allocated as usual.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+int gc_region_begin(void);
+
+/**
+ * Closes the calling thread's innermost region and frees its chunks at once,
+ * without tracing or sweeping them. Chunks holding objects that escaped are
+ * handed to the heap instead. An object escapes, along with everything in the
+ * region reachable from it, when the write barrier stores it into an object
+ * outside the region or in an enclosing one, when it becomes an ephemeron key
+ * or value, or when a root or the thread's shadow stack still holds it here.
+ * Any other pointer into the region is dangling afterwards.
+ */
+void gc_region_end(void);
+
+/**
+ * Copies the collector's statistics into stats.
+ */
+void gc_get_stats(gc_stats_t *stats);
+
+/**
+ * Clears all statistics, including the pause histogram.
+ */
+void gc_reset_stats(void);
 
 /**
  * Write barrier for pointer updates to maintain correctness during GC.
  *
+ * Stores child and, while an incremental cycle is marking, records it for the
+ * marker if parent is already marked. Takes no locks.
+ *
  * @param parent The parent object being updated.
  * @param slot   The child slot being updated.
  * @param child  The new child object.
  */
 void gc_write_barrier(object_t *parent, size_t slot, object_t *child);
 
+/**
+ * Write barrier for a store whose parent the caller does not know, such as one
+ * through a C++ gc_ptr. Finds the object containing field and applies the
+ * barrier as gc_write_barrier_field would; stores outside the heap, into a
+ * stack variable for instance, need none. The lookup makes it much slower, so
+ * callers should take it only while gc_barrier_active or gc_region_depth is set.
+ *
+ * @param field Address of the pointer field, already holding child.
+ * @param child The new child object.
+ */
+void gc_write_barrier_at(object_t **field, object_t *child);
+
+/* The object header, and the two header bits the barrier's fast path tests, are
+ * exposed only so gc_write_barrier_field can be inlined. Treat them as private. */
+struct object {
+    uint64_t header;
+};
+#define GC_HEADER_MARKED 1ULL   // GC_MARKED in tb_gc.c
+#define GC_HEADER_WEAK 128ULL   // GC_WEAK in tb_gc.c
+
+extern int gc_barrier_active;  // Non-zero while any heap's cycle is marking
+void gc_write_barrier_slow(object_t *parent, object_t **field, object_t *child);
+extern __thread int gc_region_depth;  // Regions open on the calling thread
+void gc_region_store(object_t *parent, object_t *child);
+
+/**
+ * Inline write barrier for a pointer field whose address is already known,
+ * such as an element of gc_object_children or a pointer field of a typed
+ * object. Outside marking it costs a sequentially consistent store and one
+ * well-predicted branch; while marking, only stores that put an unmarked
+ * child into a marked parent leave the fast path, and they append to a
+ * thread-local buffer - or,
+ * for arrays of 32 KB or more, set a dirty bit so the collector rescans just
+ * the modified part of the array. Inside a region, a store is also checked
+ * for region objects escaping.
+ *
+ * @param parent The object containing field.
+ * @param field  Address of the pointer field being updated.
+ * @param child  The new child object.
+ */
+static inline void gc_write_barrier_field(object_t *parent, object_t **field, object_t *child) {
+    // The store is ordered before the flag is read: a collector that turns the
+    // barrier on and then reads the field either finds child there or is seen here
+    (void)__atomic_exchange_n(field, child, __ATOMIC_SEQ_CST);
+    if (__builtin_expect(gc_region_depth, 0) && child) {
+        gc_region_store(parent, child);
+    }
+    if (__builtin_expect(__atomic_load_n(&gc_barrier_active, __ATOMIC_SEQ_CST), 0) && child &&
+        (__atomic_load_n(&parent->header, __ATOMIC_RELAXED) & (GC_HEADER_MARKED | GC_HEADER_WEAK)) == GC_HEADER_MARKED &&
+        !(__atomic_load_n(&child->header, __ATOMIC_RELAXED) & GC_HEADER_MARKED)) {
+        gc_write_barrier_slow(parent, field, child);
+    }
+}
+
 
 #ifdef __cplusplus
 }
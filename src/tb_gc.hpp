@@ -0,0 +1,204 @@
+#ifndef TB_GC_HPP
+#define TB_GC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "tb_gc.h"
+
+/* C++ interface over the typed objects of tb_gc.h. A type's pointer map is
+ * declared once, as a specialization of gc_layout, and everything derived from
+ * it - the scan bitmap, alignment and bounds checks - is computed at compile
+ * time; the type is registered with the collector on its first gc_new.
+ *
+ *     struct Node {
+ *         gc_ptr<Node> left, right;
+ *         long value;
+ *         explicit Node(long v) : value(v) {}
+ *     };
+ *     template <> struct gc_layout<Node> : gc_fields<offsetof(Node, left), offsetof(Node, right)> {};
+ *
+ *     gc_root<Node> root(gc_new<Node>(1));
+ *     root->left = gc_new<Node>(2);   // Write barrier applied by the assignment
+ *
+ * Objects live on the calling thread's current heap. The collector does not run
+ * destructors, so types must be trivially destructible. */
+
+namespace gc_detail {
+
+// Folds a list of byte offsets into the facts the collector's descriptor needs.
+template <size_t... Offsets>
+struct pointer_map;
+
+template <>
+struct pointer_map<> {
+    static constexpr bool aligned = true;
+    static constexpr size_t end = 0;       // One past the last byte of the last pointer
+    static constexpr size_t last_word = 0;
+    static constexpr uint64_t bitmap = 0;
+};
+
+template <size_t First, size_t... Rest>
+struct pointer_map<First, Rest...> {
+    static constexpr size_t word = First / sizeof(object_t *);
+    static constexpr bool aligned = First % sizeof(object_t *) == 0 && pointer_map<Rest...>::aligned;
+    static constexpr size_t end = First + sizeof(object_t *) > pointer_map<Rest...>::end
+                                      ? First + sizeof(object_t *) : pointer_map<Rest...>::end;
+    static constexpr size_t last_word = word > pointer_map<Rest...>::last_word ? word : pointer_map<Rest...>::last_word;
+    static constexpr uint64_t bitmap = (word < 64 ? 1ULL << (word % 64) : 0) | pointer_map<Rest...>::bitmap;
+};
+
+}  // namespace gc_detail
+
+/**
+ * Pointer map of a type: the byte offsets of its gc_ptr fields. Maps whose
+ * pointers all lie in the first 64 words are registered as the bitmap the
+ * collector scans; fits_bitmap says which case a type is in.
+ */
+template <size_t... Offsets>
+struct gc_fields {
+    typedef gc_detail::pointer_map<Offsets...> map;
+
+    static constexpr size_t count = sizeof...(Offsets);
+    static constexpr size_t end = map::end;
+    static constexpr bool aligned = map::aligned;
+    static constexpr bool fits_bitmap = count == 0 || map::last_word < 64;
+    static constexpr uint64_t bitmap = fits_bitmap ? map::bitmap : 0;
+
+    static const size_t *offsets() {
+        static const size_t list[] = { Offsets..., 0 };   // Sentinel keeps the array non-empty
+        return list;
+    }
+};
+
+/**
+ * Pointer map of T. Types without pointers need no specialization.
+ */
+template <typename T>
+struct gc_layout : gc_fields<> {};
+
+/**
+ * The collector's type id for T, registered from gc_layout<T> on first use.
+ */
+template <typename T>
+struct gc_type {
+    typedef gc_layout<T> layout;
+    static_assert(layout::aligned, "gc_ptr fields must be pointer aligned");
+    static_assert(layout::end <= sizeof(T), "gc_layout offset lies outside the type");
+    static_assert(std::is_trivially_destructible<T>::value, "the collector does not run destructors");
+    static_assert(alignof(T) <= sizeof(object_t *), "objects are only pointer aligned");
+
+    static gc_type_id_t id() {
+        static const gc_type_id_t registered = layout::fits_bitmap
+                                                   ? gc_register_type_bitmap(sizeof(T), layout::bitmap)
+                                                   : gc_register_type(sizeof(T), layout::offsets(), layout::count);
+        return registered;
+    }
+};
+
+/**
+ * Reference to a GC object of type T, laid out as a bare object_t pointer so
+ * it can be a field of another GC object. Every store applies the write
+ * barrier; outside marking and regions that costs a sequentially consistent
+ * store and one branch, and the parent is looked up from the field's address
+ * only when it does not.
+ *
+ * A gc_ptr is not a root. Hold objects that must survive a collection in a
+ * gc_root or a rooted object; in GC_MODE_SEMISPACE, refresh other references
+ * with gc_forward after each collection.
+ */
+template <typename T>
+class gc_ptr {
+public:
+    gc_ptr() : obj_(nullptr) {}
+    gc_ptr(std::nullptr_t) : obj_(nullptr) {}
+    explicit gc_ptr(object_t *obj) { store(obj); }
+    gc_ptr(const gc_ptr &other) { store(other.obj_); }
+
+    gc_ptr &operator=(const gc_ptr &other) {
+        store(other.obj_);
+        return *this;
+    }
+
+    gc_ptr &operator=(std::nullptr_t) {
+        obj_ = nullptr;
+        return *this;
+    }
+
+    // The payload follows the header directly, as gc_object_data returns it
+    T *get() const { return obj_ ? reinterpret_cast<T *>(obj_ + 1) : nullptr; }
+    T &operator*() const { return *get(); }
+    T *operator->() const { return get(); }
+    object_t *object() const { return obj_; }
+    explicit operator bool() const { return obj_ != nullptr; }
+
+    bool operator==(const gc_ptr &other) const { return obj_ == other.obj_; }
+    bool operator!=(const gc_ptr &other) const { return obj_ != other.obj_; }
+
+private:
+    void store(object_t *obj) {
+        // Ordered before the flag load, as in gc_write_barrier_field
+        (void)__atomic_exchange_n(&obj_, obj, __ATOMIC_SEQ_CST);
+        if (obj && __builtin_expect(gc_region_depth | __atomic_load_n(&gc_barrier_active, __ATOMIC_SEQ_CST), 0)) {
+            gc_write_barrier_at(&obj_, obj);
+        }
+    }
+
+    object_t *obj_;
+};
+
+static_assert(sizeof(gc_ptr<object_t>) == sizeof(object_t *), "gc_ptr must be a bare pointer");
+
+/**
+ * A shadow stack root for the lifetime of the scope, holding one object alive
+ * across allocations and collections. Roots must be destroyed in the reverse
+ * order of construction, which scoping guarantees.
+ */
+template <typename T>
+class gc_root {
+public:
+    explicit gc_root(const gc_ptr<T> &ptr = gc_ptr<T>()) : obj_(ptr.object()) { gc_push_root(&obj_); }
+    ~gc_root() { gc_pop_roots(1); }
+
+    gc_root(const gc_root &) = delete;
+    gc_root &operator=(const gc_root &) = delete;
+
+    gc_root &operator=(const gc_ptr<T> &ptr) {
+        obj_ = ptr.object();
+        return *this;
+    }
+
+    gc_ptr<T> get() const { return gc_ptr<T>(obj_); }
+    operator gc_ptr<T>() const { return get(); }
+    T *operator->() const { return reinterpret_cast<T *>(obj_ + 1); }
+    T &operator*() const { return *operator->(); }
+    explicit operator bool() const { return obj_ != nullptr; }
+
+private:
+    object_t *obj_;
+};
+
+/**
+ * Allocates a T on the current heap and constructs it from args. The object is
+ * a root while its constructor runs, so the constructor may itself allocate;
+ * in GC_MODE_SEMISPACE it must not, since a collection would move the object
+ * under construction.
+ *
+ * @return The new object, or a null gc_ptr if allocation failed.
+ */
+template <typename T, typename... Args>
+gc_ptr<T> gc_new(Args &&... args) {
+    void *data = gc_alloc_typed(gc_type<T>::id());
+    if (!data) return gc_ptr<T>();
+
+    object_t *obj = gc_object_of(data);
+    gc_push_root(&obj);
+    new (data) T(std::forward<Args>(args)...);
+    gc_pop_roots(1);
+    return gc_ptr<T>(obj);
+}
+
+#endif // TB_GC_HPP
@@ -0,0 +1,186 @@
+#include "tb_simd.h"
+#include <immintrin.h>
+
+// The vector versions are compiled for their instruction set with target
+// attributes, so the rest of the build needs no -m flags; they are only called
+// once __builtin_cpu_supports has vouched for the CPU.
+
+typedef size_t (*filter_slots_fn)(void *const *, size_t, uintptr_t, uintptr_t, void **);
+typedef int (*split_marks_fn)(const uint64_t *, const uint64_t *, uint64_t *, uint64_t *, size_t);
+
+/* ========================= SCALAR ========================= */
+
+// One unsigned compare covers both bounds: below lo wraps around to a huge offset.
+static size_t filter_slots_scalar(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((uintptr_t)slots[i] - lo < hi - lo) {
+            out[count++] = slots[i];
+        }
+    }
+    return count;
+}
+
+static int split_marks_scalar(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n) {
+    uint64_t any = 0;
+    for (size_t i = 0; i < n; i++) {
+        live[i] = starts[i] & marks[i];
+        dead[i] = starts[i] & ~marks[i];
+        any |= live[i];
+    }
+    return any != 0;
+}
+
+/* ========================= SSE4.2 ========================= */
+
+// x86 only has signed 64-bit compares; flipping the sign bit of both sides turns
+// them into the unsigned compare the scalar loop makes.
+__attribute__((target("sse4.2")))
+static size_t filter_slots_sse4(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out) {
+    const __m128i bias = _mm_set1_epi64x(INT64_MIN);
+    const __m128i base = _mm_set1_epi64x((long long)lo);
+    const __m128i span = _mm_set1_epi64x((long long)((hi - lo) ^ (1ULL << 63)));
+    size_t count = 0, i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i ptrs = _mm_loadu_si128((const __m128i *)(slots + i));
+        __m128i offset = _mm_xor_si128(_mm_sub_epi64(ptrs, base), bias);
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(span, offset)));
+        if (mask & 1) out[count++] = slots[i];
+        if (mask & 2) out[count++] = slots[i + 1];
+    }
+    return count + filter_slots_scalar(slots + i, n - i, lo, hi, out + count);
+}
+
+__attribute__((target("sse4.2")))
+static int split_marks_sse4(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n) {
+    __m128i any = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(starts + i));
+        __m128i m = _mm_loadu_si128((const __m128i *)(marks + i));
+        __m128i l = _mm_and_si128(s, m);
+        _mm_storeu_si128((__m128i *)(live + i), l);
+        _mm_storeu_si128((__m128i *)(dead + i), _mm_andnot_si128(m, s));
+        any = _mm_or_si128(any, l);
+    }
+    int tail_live = split_marks_scalar(starts + i, marks + i, live + i, dead + i, n - i);
+    return tail_live || !_mm_testz_si128(any, any);
+}
+
+/* ========================= AVX2 ========================= */
+
+// For each 4-bit lane mask, the 32-bit lane permutation that packs the selected
+// 64-bit lanes to the front, in order.
+static const uint32_t pack_lanes[16][8] = {
+    { 0, 1, 0, 1, 0, 1, 0, 1 }, { 0, 1, 0, 1, 0, 1, 0, 1 }, { 2, 3, 0, 1, 0, 1, 0, 1 }, { 0, 1, 2, 3, 0, 1, 0, 1 },
+    { 4, 5, 0, 1, 0, 1, 0, 1 }, { 0, 1, 4, 5, 0, 1, 0, 1 }, { 2, 3, 4, 5, 0, 1, 0, 1 }, { 0, 1, 2, 3, 4, 5, 0, 1 },
+    { 6, 7, 0, 1, 0, 1, 0, 1 }, { 0, 1, 6, 7, 0, 1, 0, 1 }, { 2, 3, 6, 7, 0, 1, 0, 1 }, { 0, 1, 2, 3, 6, 7, 0, 1 },
+    { 4, 5, 6, 7, 0, 1, 0, 1 }, { 0, 1, 4, 5, 6, 7, 0, 1 }, { 2, 3, 4, 5, 6, 7, 0, 1 }, { 0, 1, 2, 3, 4, 5, 6, 7 },
+};
+
+// Left-packs the qualifying pointers of each group of four with one permute and an
+// unaligned store of all four lanes; the lanes past the count are overwritten by
+// the next group. The store never passes out + n since count <= i.
+__attribute__((target("avx2")))
+static size_t filter_slots_avx2(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out) {
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i base = _mm256_set1_epi64x((long long)lo);
+    const __m256i span = _mm256_set1_epi64x((long long)((hi - lo) ^ (1ULL << 63)));
+    size_t count = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i ptrs = _mm256_loadu_si256((const __m256i *)(slots + i));
+        __m256i offset = _mm256_xor_si256(_mm256_sub_epi64(ptrs, base), bias);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(span, offset)));
+        if (!mask) continue;
+        __m256i lanes = _mm256_loadu_si256((const __m256i *)pack_lanes[mask]);
+        _mm256_storeu_si256((__m256i *)(out + count), _mm256_permutevar8x32_epi32(ptrs, lanes));
+        count += (size_t)__builtin_popcount((unsigned)mask);
+    }
+    return count + filter_slots_scalar(slots + i, n - i, lo, hi, out + count);
+}
+
+__attribute__((target("avx2")))
+static int split_marks_avx2(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n) {
+    __m256i any = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(starts + i));
+        __m256i m = _mm256_loadu_si256((const __m256i *)(marks + i));
+        __m256i l = _mm256_and_si256(s, m);
+        _mm256_storeu_si256((__m256i *)(live + i), l);
+        _mm256_storeu_si256((__m256i *)(dead + i), _mm256_andnot_si256(m, s));
+        any = _mm256_or_si256(any, l);
+    }
+    int tail_live = split_marks_scalar(starts + i, marks + i, live + i, dead + i, n - i);
+    return tail_live || !_mm256_testz_si256(any, any);
+}
+
+/* ========================= DISPATCH ========================= */
+
+// The kernels start out as resolvers that select the best level and forward the
+// call. Racing first calls all store the same pointers.
+static size_t filter_slots_resolve(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out);
+static int split_marks_resolve(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n);
+
+static filter_slots_fn filter_slots_impl = filter_slots_resolve;
+static split_marks_fn split_marks_impl = split_marks_resolve;
+static tb_simd_level_t simd_level = TB_SIMD_SCALAR;
+
+tb_simd_level_t tb_simd_detect(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return TB_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return TB_SIMD_SSE4;
+    return TB_SIMD_SCALAR;
+}
+
+tb_simd_level_t tb_simd_select(tb_simd_level_t level) {
+    tb_simd_level_t best = tb_simd_detect();
+    if (level > best) level = best;
+
+    filter_slots_fn filter = filter_slots_scalar;
+    split_marks_fn split = split_marks_scalar;
+    if (level == TB_SIMD_AVX2) {
+        filter = filter_slots_avx2;
+        split = split_marks_avx2;
+    } else if (level == TB_SIMD_SSE4) {
+        filter = filter_slots_sse4;
+        split = split_marks_sse4;
+    }
+    __atomic_store_n(&simd_level, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&filter_slots_impl, filter, __ATOMIC_RELAXED);
+    __atomic_store_n(&split_marks_impl, split, __ATOMIC_RELAXED);
+    return level;
+}
+
+tb_simd_level_t tb_simd_level(void) {
+    if (__atomic_load_n(&filter_slots_impl, __ATOMIC_RELAXED) == filter_slots_resolve) {
+        tb_simd_select(tb_simd_detect());
+    }
+    return __atomic_load_n(&simd_level, __ATOMIC_RELAXED);
+}
+
+const char *tb_simd_name(tb_simd_level_t level) {
+    switch (level) {
+    case TB_SIMD_AVX2: return "avx2";
+    case TB_SIMD_SSE4: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+static size_t filter_slots_resolve(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out) {
+    tb_simd_select(tb_simd_detect());
+    return tb_filter_slots(slots, n, lo, hi, out);
+}
+
+static int split_marks_resolve(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n) {
+    tb_simd_select(tb_simd_detect());
+    return tb_split_marks(starts, marks, live, dead, n);
+}
+
+size_t tb_filter_slots(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out) {
+    return __atomic_load_n(&filter_slots_impl, __ATOMIC_RELAXED)(slots, n, lo, hi, out);
+}
+
+int tb_split_marks(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n) {
+    return __atomic_load_n(&split_marks_impl, __ATOMIC_RELAXED)(starts, marks, live, dead, n);
+}
@@ -0,0 +1,44 @@
+#ifndef TB_SIMD_H
+#define TB_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Data-parallel kernels used by the collector. Each has a scalar, an SSE4.2 and
+ * an AVX2 version; the best one the CPU supports is picked on first use. */
+typedef enum {
+    TB_SIMD_SCALAR,
+    TB_SIMD_SSE4,
+    TB_SIMD_AVX2
+} tb_simd_level_t;
+
+/* Best level this CPU supports */
+tb_simd_level_t tb_simd_detect(void);
+
+/* Switches every kernel to the given level, capped at what the CPU supports.
+ * Meant for benchmarks and tests; returns the level actually selected. */
+tb_simd_level_t tb_simd_select(tb_simd_level_t level);
+
+/* Level in use, and a printable name for a level */
+tb_simd_level_t tb_simd_level(void);
+const char *tb_simd_name(tb_simd_level_t level);
+
+/* Copies the pointers of slots[0, n) that fall within [lo, hi) to out, keeping
+ * their order, and returns how many there were. NULL never qualifies as long
+ * as lo is above zero. out must have room for n pointers. */
+size_t tb_filter_slots(void *const *slots, size_t n, uintptr_t lo, uintptr_t hi, void **out);
+
+/* Splits n words of an object-start bitmap by a mark bitmap: live[i] gets the
+ * starts that are marked and dead[i] those that are not. Returns non-zero if
+ * any start is live, so a run of entirely dead words needs no further look. */
+int tb_split_marks(const uint64_t *starts, const uint64_t *marks, uint64_t *live, uint64_t *dead, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TB_SIMD_H
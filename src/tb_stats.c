@@ -0,0 +1,53 @@
+#include "tb_stats.h"
+#include <time.h>
+
+#define SUB_BUCKETS (1 << TB_HIST_SUB_BITS)
+
+uint64_t tb_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Values below SUB_BUCKETS get a bucket each; above that, the position of the top
+// bit picks the power of two and the next TB_HIST_SUB_BITS bits the sub-bucket.
+static unsigned bucket_of(uint64_t value) {
+    if (value < SUB_BUCKETS) return (unsigned)value;
+
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned sub = (unsigned)(value >> (msb - TB_HIST_SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (msb - TB_HIST_SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_upper_bound(unsigned bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    unsigned msb = bucket / SUB_BUCKETS + TB_HIST_SUB_BITS - 1;
+    unsigned sub = bucket % SUB_BUCKETS;
+    uint64_t width = 1ULL << (msb - TB_HIST_SUB_BITS);
+    return ((uint64_t)(SUB_BUCKETS + sub) << (msb - TB_HIST_SUB_BITS)) + width - 1;
+}
+
+void tb_histogram_record(tb_histogram_t *hist, uint64_t value) {
+    hist->counts[bucket_of(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max) hist->max = value;
+}
+
+uint64_t tb_histogram_percentile(const tb_histogram_t *hist, double quantile) {
+    if (!hist->count) return 0;
+
+    uint64_t rank = (uint64_t)(quantile * (double)hist->count);
+    if (rank >= hist->count) rank = hist->count - 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < TB_HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen > rank) {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < hist->max ? bound : hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,34 @@
+#ifndef TB_STATS_H
+#define TB_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Log-bucketed histogram: each power of two is split into 2^TB_HIST_SUB_BITS
+ * linear sub-buckets, so any recorded value is reported within 25%. */
+#define TB_HIST_SUB_BITS 2
+#define TB_HIST_BUCKETS (64 << TB_HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[TB_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} tb_histogram_t;
+
+/* Monotonic clock in nanoseconds */
+uint64_t tb_now_ns(void);
+
+void tb_histogram_record(tb_histogram_t *hist, uint64_t value);
+
+/* Upper bound of the bucket holding the given quantile (0.0 - 1.0), capped at max */
+uint64_t tb_histogram_percentile(const tb_histogram_t *hist, double quantile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TB_STATS_H
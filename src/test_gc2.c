@@ -14,20 +14,6 @@
 #define CLEAR_THRESHOLD 10000
 #define TASK_DELAY_MICROS 1000
 
-typedef struct object {
-    size_t size;
-    uint8_t marked;
-    struct object **children;
-    size_t child_count;
-    struct object *next_object;
-} object_t;
-
-/* extern object_t *all_objects; */
-
-object_t *extract_object(void *user_ptr, size_t child_count) {
-    return (object_t *)((uint8_t *)user_ptr - sizeof(object_t) - sizeof(object_t *) * child_count);
-}
-
 long get_memory_usage() {
     struct rusage usage;
     getrusage(RUSAGE_SELF, &usage);
@@ -62,7 +48,8 @@ int main() {
 
     gc_init();
 
-    // Track GC statistics
+    // Collections are triggered by the collector itself; we only read its count
+    gc_stats_t stats;
     int gc_runs = 0;
     struct timespec start_time, end_time;
 
@@ -74,11 +61,11 @@ int main() {
     for (int i = 0; i < MAX_ITERATIONS; i++) {
         // Step 1: Allocate a node with children
         void *user_data = gc_alloc(32, CHILDREN_PER_NODE);  // Allocate object
-        object_t *obj = extract_object(user_data, CHILDREN_PER_NODE);  // Get object header
+        object_t *obj = gc_object_of(user_data);  // Get object header
 
         // Step 2: Add to root set
-        gc_add_root(obj);
-        roots[root_count++] = obj;
+        roots[root_count] = obj;
+        gc_push_root(&roots[root_count++]);
 
         // Step 3: Simulate task and measure task delay
         clock_gettime(CLOCK_MONOTONIC, &start_time);
@@ -86,32 +73,25 @@ int main() {
         clock_gettime(CLOCK_MONOTONIC, &end_time);
         long task_delay_us = (end_time.tv_nsec - start_time.tv_nsec) / 1000;  // Convert to microseconds
 
-        // Step 4: Periodically clear roots to trigger GC
+        // Step 4: Periodically clear roots to simulate the end of a task and make
+        // objects unreachable; the collector reclaims them when it next runs
         if (root_count > CLEAR_THRESHOLD) {
-            // Clear roots to simulate the end of a task and make objects unreachable
-            gc_remove_root(roots[0]);  // Remove the first root object
-            for (int j = 1; j < root_count; j++) {
-                gc_remove_root(roots[j]);
-            }
+            gc_pop_roots(root_count);
             root_count = 0;
-            gc_collect_full();
-            gc_runs++;  // Count a GC run
         }
 
         // Step 5: Optionally print memory usage
         if (i % 10000 == 0) {
+            gc_get_stats(&stats);
+            gc_runs = (int)stats.collections;
             long memory_usage = get_memory_usage();  // Get memory usage
             output_csv(csv_file, i, task_delay_us, gc_runs, memory_usage);  // Write results to CSV
         }
-
-        // Step 6: Periodically run GC
-        if (i % 5000 == 0) {
-            gc_collect_full();  // Run a full GC cycle
-            gc_runs++;  // Count the GC run
-        }
     }
 
     // Final output to CSV
+    gc_get_stats(&stats);
+    gc_runs = (int)stats.collections;
     long memory_usage = get_memory_usage();
     output_csv(csv_file, MAX_ITERATIONS, 0, gc_runs, memory_usage);  // Write final results to CSV
 
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Write barrier: correctness of the thread-local buffers when several threads
+// shade at once, and the cost of a barriered store against a plain one.
+
+#define THREADS 4
+#define LEAVES 5000          // Per thread; spans several buffer segments
+#define CHAIN 20000          // Long enough that one step cannot reach its end
+#define STORES 10000000
+#define SLOW_STORES 1000000
+#define SLOTS 64
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static object_t *new_node(long value, size_t children) {
+    long *data = gc_alloc(sizeof(long), children);
+    assert(data);
+    *data = value;
+    return gc_object_of(data);
+}
+
+typedef struct {
+    object_t *holder;  // Allocated mid-cycle, so born marked
+    object_t *source;  // At the end of the chain; not yet scanned
+} mover_t;
+
+// Moves every leaf from the unscanned source to the already marked holder
+static void *move_leaves(void *arg) {
+    mover_t *mover = arg;
+    for (size_t i = 0; i < LEAVES; i++) {
+        gc_write_barrier(mover->holder, i, gc_get_child(mover->source, i));
+        gc_write_barrier(mover->source, i, NULL);
+    }
+    return NULL;
+}
+
+void test_threaded_shading() {
+    printf("=== Test: Threaded Shading ===\n");
+    gc_init();
+
+    mover_t movers[THREADS];
+    object_t *chain = NULL;
+    gc_push_root(&chain);
+    for (int t = 0; t < THREADS; t++) {
+        movers[t].source = new_node(t, LEAVES);
+        gc_push_root(&movers[t].source);  // Until the chain holds it
+        for (long i = 0; i < LEAVES; i++) {
+            gc_write_barrier(movers[t].source, i, new_node(t * LEAVES + i, 0));
+        }
+    }
+    for (long i = 0; i < CHAIN; i++) {
+        object_t *node = new_node(i, 1 + THREADS);
+        gc_write_barrier(node, 0, chain);
+        chain = node;
+    }
+    for (int t = 0; t < THREADS; t++) {
+        gc_write_barrier(chain, 1 + t, movers[t].source);
+    }
+    // The sources hang off the first chain node; reverse so they are scanned last
+    object_t *prev = NULL;
+    while (chain) {
+        object_t *next = gc_get_child(chain, 0);
+        gc_write_barrier(chain, 0, prev);
+        prev = chain;
+        chain = next;
+    }
+    chain = prev;
+    gc_pop_roots(THREADS);
+
+    assert(gc_collect_step() == 0);
+    for (int t = 0; t < THREADS; t++) {
+        movers[t].holder = new_node(t, LEAVES);
+        gc_add_root(movers[t].holder);
+    }
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, move_leaves, &movers[t]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    while (!gc_collect_step()) {
+    }
+
+    for (int t = 0; t < THREADS; t++) {
+        for (long i = 0; i < LEAVES; i++) {
+            object_t *leaf = gc_get_child(movers[t].holder, i);
+            assert(findObj(leaf) && *(long *)gc_object_data(leaf) == t * LEAVES + i);
+        }
+        gc_remove_root(movers[t].holder);
+    }
+    printf("%d leaves shaded from %d threads survived\n", THREADS * LEAVES, THREADS);
+    gc_pop_roots(1);
+}
+
+static double time_stores(object_t *parent, object_t **children, object_t *child, long n, int barrier) {
+    double start = now_ns();
+    for (long i = 0; i < n; i++) {
+        if (barrier) {
+            gc_write_barrier_field(parent, &children[i % SLOTS], child);
+        } else {
+            children[i % SLOTS] = child;
+        }
+        __asm__ volatile("" ::: "memory");
+    }
+    return (now_ns() - start) / n;
+}
+
+void bench_store_cost() {
+    printf("=== Bench: Store Cost ===\n");
+    gc_init();
+
+    object_t *parent = new_node(0, SLOTS);
+    object_t *child = new_node(1, 0);
+    object_t *chain = NULL;
+    gc_push_root(&parent);
+    gc_push_root(&child);
+    gc_push_root(&chain);
+    object_t *tail = NULL;
+    for (long i = 0; i < CHAIN; i++) {
+        object_t *node = new_node(i, 1);
+        gc_write_barrier(node, 0, chain);
+        chain = node;
+        if (!tail) tail = node;
+    }
+    object_t **children = gc_object_children(parent);
+
+    double plain = time_stores(parent, children, child, STORES, 0);
+    double idle = time_stores(parent, children, child, STORES, 1);
+
+    // Mid-cycle the roots are marked, so stores of a marked child are filtered out
+    assert(gc_collect_step() == 0);
+    double marking = time_stores(parent, children, child, STORES, 1);
+    while (!gc_collect_step()) {
+    }
+
+    // A child the marker has not reached yet, stored into a marked parent, takes
+    // the slow path every time
+    object_t *leaf = new_node(2, 0);
+    gc_write_barrier(tail, 0, leaf);
+    assert(gc_collect_step() == 0);
+    double slow = time_stores(parent, children, leaf, SLOW_STORES, 1);
+    while (!gc_collect_step()) {
+    }
+    assert(findObj(leaf));
+
+    printf("plain store:         %6.2f ns\n", plain);
+    printf("barrier, idle:       %6.2f ns (%.2fx)\n", idle, idle / plain);
+    printf("barrier, marking:    %6.2f ns (%.2fx)\n", marking, marking / plain);
+    printf("barrier, slow path:  %6.2f ns (%.2fx)\n", slow, slow / plain);
+    gc_pop_roots(3);
+}
+
+int main() {
+    test_threaded_shading();
+    bench_store_cost();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Measures mark throughput on a pointer-heavy heap at several prefetch
+// distances. Every node points at four random others, so almost every edge the
+// marker follows lands on a cold cache line.
+
+#define NODES 400000
+#define EDGES 4
+#define RUNS 10
+
+static const size_t distances[] = { 0, 2, 4, 8, 16, 32, 63 };
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+int main() {
+    gc_init();
+
+    // A rooted index array keeps every node reachable while the edges are wired
+    object_t *index = gc_object_of(gc_alloc(0, NODES));
+    gc_add_root(index);
+    for (size_t i = 0; i < NODES; i++) {
+        gc_write_barrier(index, i, gc_object_of(gc_alloc(16, EDGES)));
+    }
+    for (size_t i = 0; i < NODES; i++) {
+        object_t *node = gc_get_child(index, i);
+        for (size_t e = 0; e < EDGES; e++) {
+            gc_write_barrier(node, e, gc_get_child(index, next_random() % NODES));
+        }
+    }
+
+    // Mark from a single node; the random graph reaches nearly all the rest
+    object_t *start = gc_get_child(index, 0);
+    gc_add_root(start);
+    gc_remove_root(index);
+    gc_collect_full();
+
+    gc_stats_t stats;
+    gc_reset_stats();
+    gc_collect_full();
+    gc_get_stats(&stats);
+    uint64_t live = stats.objects_marked;
+    gc_reset_stats();
+
+    // Rounds interleave the distances and keep each one's best time, so a noisy
+    // neighbour slows every distance alike instead of skewing one of them
+    size_t count = sizeof(distances) / sizeof(distances[0]);
+    uint64_t best_ns[sizeof(distances) / sizeof(distances[0])];
+    for (size_t d = 0; d < count; d++) best_ns[d] = UINT64_MAX;
+    for (int r = 0; r < RUNS; r++) {
+        for (size_t d = 0; d < count; d++) {
+            gc_set_prefetch_distance(distances[d]);
+            gc_collect_full();
+            gc_get_stats(&stats);
+            if (stats.last_mark_ns < best_ns[d]) best_ns[d] = stats.last_mark_ns;
+        }
+    }
+    gc_get_stats(&stats);
+    assert(stats.objects_marked == live * RUNS * count);
+
+    printf("%-10s %12s %14s\n", "distance", "mark ms", "edges/us");
+    for (size_t d = 0; d < count; d++) {
+        double mark_ms = best_ns[d] / 1e6;
+        printf("%-10zu %12.3f %14.1f  (%.2fx)\n", distances[d], mark_ms,
+               (double)live * EDGES / (mark_ms * 1e3), (double)best_ns[0] / best_ns[d]);
+    }
+
+    gc_set_prefetch_distance(8);
+    gc_remove_root(start);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Compares the mark-sweep and semispace collectors on a short-lived,
+// allocation-heavy pattern: a small rooted list survives while most
+// allocations die young.
+
+#define ROUNDS 20
+#define GARBAGE_PER_ROUND 2000
+#define LIVE_NODES 64
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static size_t list_length(object_t *head) {
+    size_t n = 0;
+    while (head) {
+        n++;
+        head = gc_get_child(head, 0);
+    }
+    return n;
+}
+
+static void run(gc_mode_t mode, const char *name) {
+    gc_init_mode(mode);
+    gc_reset_stats();
+
+    // Build the long-lived list, rooted at its head
+    object_t *head = gc_object_of(gc_alloc(16, 1));
+    gc_add_root(head);
+    object_t *tail = head;
+    for (int i = 1; i < LIVE_NODES; i++) {
+        object_t *node = gc_object_of(gc_alloc(16, 1));
+        gc_write_barrier(tail, 0, node);
+        tail = node;
+    }
+
+    double alloc_ms = 0, gc_ms = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        double t0 = now_ms();
+        for (int i = 0; i < GARBAGE_PER_ROUND; i++) {
+            void *data = gc_alloc(48, 2);
+            assert(data != NULL);
+            memset(data, 0xAB, 48);
+        }
+        double t1 = now_ms();
+        gc_collect_full();
+        double t2 = now_ms();
+
+        alloc_ms += t1 - t0;
+        gc_ms += t2 - t1;
+
+        // The root set was updated in place; re-derive our handle
+        head = gc_forward(head);
+        assert(head != NULL);
+        assert(list_length(head) == LIVE_NODES);
+    }
+
+    printf("%-10s alloc: %8.3f ms  collect: %8.3f ms  (%d objects/round)\n",
+           name, alloc_ms, gc_ms, GARBAGE_PER_ROUND);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.collections == ROUNDS);
+    assert(stats.objects_freed >= (uint64_t)(ROUNDS - 1) * GARBAGE_PER_ROUND);
+    printf("%-10s pause p50: %6.1f us  p99: %6.1f us  p99.9: %6.1f us  max: %6.1f us\n",
+           "", stats.pause_p50_ns / 1e3, stats.pause_p99_ns / 1e3,
+           stats.pause_p999_ns / 1e3, stats.pause_max_ns / 1e3);
+    printf("%-10s roots: %.3f ms  mark: %.3f ms  sweep: %.3f ms  freed: %llu objects\n",
+           "", stats.root_scan_ns / 1e6, stats.mark_ns / 1e6, stats.sweep_ns / 1e6,
+           (unsigned long long)stats.objects_freed);
+    gc_remove_root(head);
+}
+
+int main() {
+    run(GC_MODE_MARK_SWEEP, "mark-sweep");
+    run(GC_MODE_SEMISPACE, "semispace");
+    return 0;
+}
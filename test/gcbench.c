@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "tb_gc.h"
+
+// Throughput suite in the style of GCBench: four workloads, each run once against
+// the collector and once against glibc malloc/free, every run in a process of its
+// own so peak RSS and collector state do not carry over. Results go to a CSV file,
+// one row per run, and a summary to stdout. Built and run by `make bench`.
+//
+//   gcbench [output.csv] [workload...]
+
+/* GCBench parameters, scaled to the collector's 64 MB heap limit */
+#define STRETCH_TREE_DEPTH 18
+#define LONG_LIVED_TREE_DEPTH 16
+#define ARRAY_SIZE 500000
+#define MIN_TREE_DEPTH 4
+#define MAX_TREE_DEPTH 16
+
+#define LIST_LENGTH 100000
+#define LIST_OPS 3000000
+
+#define GRAPH_NODES 50000
+#define GRAPH_EDGES 4
+#define GRAPH_OPS 1000000
+
+#define MIXED_WINDOW 4096
+#define MIXED_OPS 500000
+#define MIXED_LARGE_EVERY 32          // One allocation in this many is large
+#define MIXED_SMALL_MAX 512
+#define MIXED_LARGE_MIN (32 * 1024)
+#define MIXED_LARGE_MAX (256 * 1024)
+
+typedef enum { USE_GC, USE_MALLOC } allocator_kind_t;
+
+typedef struct {
+    int ok;
+    uint64_t allocations;
+    uint64_t bytes;
+    double elapsed_ms;
+    uint64_t collections;
+    double collection_ms;
+    long peak_rss_kb;
+    uint64_t pause_p50_ns;
+    uint64_t pause_p99_ns;
+    uint64_t pause_p999_ns;
+    uint64_t pause_max_ns;
+} result_t;
+
+typedef int (*workload_fn)(allocator_kind_t kind);
+
+// Counted by every allocation a workload makes, in the bytes it asks for
+static uint64_t allocations;
+static uint64_t bytes_allocated;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rng_below(size_t n) {
+    return (size_t)(rng_next() % n);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static object_t *gc_new_object(size_t size, size_t child_slots) {
+    allocations++;
+    bytes_allocated += size + child_slots * sizeof(object_t *);
+    return gc_object_of(gc_alloc(size, child_slots));
+}
+
+static void *malloc_counted(size_t size) {
+    allocations++;
+    bytes_allocated += size;
+    return malloc(size);
+}
+
+/* ========================= BINARY TREES ========================= */
+
+// GCBench: a stretch tree, a long-lived tree and array that stay live throughout,
+// then temporary trees of growing depth built top-down and bottom-up.
+
+typedef struct tree_node {
+    struct tree_node *left;
+    struct tree_node *right;
+    int32_t i, j;
+} tree_node_t;
+
+static int tree_size(int depth) {
+    return (1 << (depth + 1)) - 1;
+}
+
+static int tree_iterations(int depth) {
+    return 2 * tree_size(STRETCH_TREE_DEPTH) / tree_size(depth);
+}
+
+static object_t *gc_tree_node(void) {
+    return gc_new_object(2 * sizeof(int32_t), 2);
+}
+
+// The caller keeps node reachable, and so everything populated below it
+static void gc_populate(int depth, object_t *node) {
+    if (depth-- <= 0) return;
+    gc_write_barrier(node, 0, gc_tree_node());
+    gc_write_barrier(node, 1, gc_tree_node());
+    gc_populate(depth, gc_get_child(node, 0));
+    gc_populate(depth, gc_get_child(node, 1));
+}
+
+static object_t *gc_make_tree(int depth) {
+    if (depth <= 0) return gc_tree_node();
+    object_t *left = gc_make_tree(depth - 1);
+    gc_push_root(&left);
+    object_t *right = gc_make_tree(depth - 1);
+    gc_push_root(&right);
+    object_t *node = gc_tree_node();
+    gc_write_barrier(node, 0, left);
+    gc_write_barrier(node, 1, right);
+    gc_pop_roots(2);
+    return node;
+}
+
+static int gc_tree_count(object_t *node) {
+    return node ? 1 + gc_tree_count(gc_get_child(node, 0)) + gc_tree_count(gc_get_child(node, 1)) : 0;
+}
+
+static tree_node_t *malloc_tree_node(void) {
+    tree_node_t *node = malloc_counted(sizeof(tree_node_t));
+    node->left = node->right = NULL;
+    return node;
+}
+
+static void malloc_populate(int depth, tree_node_t *node) {
+    if (depth-- <= 0) return;
+    node->left = malloc_tree_node();
+    node->right = malloc_tree_node();
+    malloc_populate(depth, node->left);
+    malloc_populate(depth, node->right);
+}
+
+static tree_node_t *malloc_make_tree(int depth) {
+    if (depth <= 0) return malloc_tree_node();
+    tree_node_t *node = malloc_tree_node();
+    node->left = malloc_make_tree(depth - 1);
+    node->right = malloc_make_tree(depth - 1);
+    return node;
+}
+
+static void malloc_free_tree(tree_node_t *node) {
+    if (!node) return;
+    malloc_free_tree(node->left);
+    malloc_free_tree(node->right);
+    free(node);
+}
+
+static int malloc_tree_count(tree_node_t *node) {
+    return node ? 1 + malloc_tree_count(node->left) + malloc_tree_count(node->right) : 0;
+}
+
+static int run_binary_trees(allocator_kind_t kind) {
+    if (kind == USE_MALLOC) {
+        malloc_free_tree(malloc_make_tree(STRETCH_TREE_DEPTH));
+        tree_node_t *long_lived = malloc_tree_node();
+        malloc_populate(LONG_LIVED_TREE_DEPTH, long_lived);
+        double *array = malloc_counted(sizeof(double) * ARRAY_SIZE);
+        for (int i = 0; i < ARRAY_SIZE / 2; i++) {
+            array[i] = 1.0 / (i + 1);
+        }
+
+        for (int d = MIN_TREE_DEPTH; d <= MAX_TREE_DEPTH; d += 2) {
+            for (int i = 0, n = tree_iterations(d); i < n; i++) {
+                tree_node_t *temp = malloc_tree_node();
+                malloc_populate(d, temp);
+                malloc_free_tree(temp);
+                malloc_free_tree(malloc_make_tree(d));
+            }
+        }
+
+        int ok = malloc_tree_count(long_lived) == tree_size(LONG_LIVED_TREE_DEPTH) && array[1000] == 1.0 / 1001;
+        malloc_free_tree(long_lived);
+        free(array);
+        return ok;
+    }
+
+    gc_make_tree(STRETCH_TREE_DEPTH);
+    object_t *long_lived = gc_tree_node();
+    gc_push_root(&long_lived);
+    gc_populate(LONG_LIVED_TREE_DEPTH, long_lived);
+    object_t *array = gc_new_object(sizeof(double) * ARRAY_SIZE, 0);
+    gc_push_root(&array);
+    for (int i = 0; i < ARRAY_SIZE / 2; i++) {
+        ((double *)gc_object_data(array))[i] = 1.0 / (i + 1);
+    }
+
+    for (int d = MIN_TREE_DEPTH; d <= MAX_TREE_DEPTH; d += 2) {
+        for (int i = 0, n = tree_iterations(d); i < n; i++) {
+            object_t *temp = gc_tree_node();
+            gc_push_root(&temp);
+            gc_populate(d, temp);
+            gc_pop_roots(1);
+            gc_make_tree(d);
+        }
+    }
+
+    int ok = gc_tree_count(long_lived) == tree_size(LONG_LIVED_TREE_DEPTH) &&
+             ((double *)gc_object_data(array))[1000] == 1.0 / 1001;
+    gc_pop_roots(2);
+    return ok;
+}
+
+/* ========================= LIST CHURN ========================= */
+
+// A long-lived queue: every operation appends a node at the tail and drops the
+// one at the head, so the live size stays fixed while the whole list turns over.
+
+typedef struct list_node {
+    struct list_node *next;
+    uint64_t value;
+} list_node_t;
+
+static int run_list_churn(allocator_kind_t kind) {
+    uint64_t sum = 0;
+    if (kind == USE_MALLOC) {
+        list_node_t *head = malloc_counted(sizeof(list_node_t));
+        list_node_t *tail = head;
+        head->next = NULL;
+        head->value = 0;
+        for (uint64_t i = 1; i < LIST_LENGTH + LIST_OPS; i++) {
+            list_node_t *node = malloc_counted(sizeof(list_node_t));
+            node->next = NULL;
+            node->value = i;
+            tail->next = node;
+            tail = node;
+            if (i >= LIST_LENGTH) {
+                list_node_t *dead = head;
+                head = head->next;
+                free(dead);
+            }
+        }
+        while (head) {
+            list_node_t *next = head->next;
+            sum += head->value;
+            free(head);
+            head = next;
+        }
+    } else {
+        // Slot 0 holds the head, slot 1 the tail
+        object_t *queue = gc_new_object(0, 2);
+        gc_push_root(&queue);
+        object_t *first = gc_new_object(sizeof(uint64_t), 1);
+        *(uint64_t *)gc_object_data(first) = 0;
+        gc_write_barrier(queue, 0, first);
+        gc_write_barrier(queue, 1, first);
+        for (uint64_t i = 1; i < LIST_LENGTH + LIST_OPS; i++) {
+            object_t *node = gc_new_object(sizeof(uint64_t), 1);
+            *(uint64_t *)gc_object_data(node) = i;
+            gc_write_barrier(gc_get_child(queue, 1), 0, node);
+            gc_write_barrier(queue, 1, node);
+            if (i >= LIST_LENGTH) {
+                gc_write_barrier(queue, 0, gc_get_child(gc_get_child(queue, 0), 0));
+            }
+        }
+        for (object_t *node = gc_get_child(queue, 0); node; node = gc_get_child(node, 0)) {
+            sum += *(uint64_t *)gc_object_data(node);
+        }
+        gc_pop_roots(1);
+    }
+
+    // The surviving values are the last LIST_LENGTH of 0 .. LIST_LENGTH + LIST_OPS - 1
+    uint64_t first = LIST_OPS, last = LIST_OPS + LIST_LENGTH - 1;
+    return sum == (first + last) * LIST_LENGTH / 2;
+}
+
+/* ========================= GRAPH MUTATION ========================= */
+
+// A table of nodes, each with edges to random others. Every operation makes a
+// node pointing at random table entries, points a random existing edge at it and
+// replaces a random table entry with it. Under the collector a replaced node lives
+// on while edges still reach it; the malloc version frees it at once, and its
+// dangling edges are never followed.
+
+typedef struct graph_node {
+    struct graph_node *edges[GRAPH_EDGES];
+    uint64_t id;
+} graph_node_t;
+
+static int run_graph_mutation(allocator_kind_t kind) {
+    uint64_t checksum = 0;
+    if (kind == USE_MALLOC) {
+        graph_node_t **table = malloc(sizeof(graph_node_t *) * GRAPH_NODES);
+        for (size_t i = 0; i < GRAPH_NODES; i++) {
+            table[i] = malloc_counted(sizeof(graph_node_t));
+            memset(table[i]->edges, 0, sizeof(table[i]->edges));
+            table[i]->id = i;
+        }
+        for (uint64_t op = 0; op < GRAPH_OPS; op++) {
+            graph_node_t *node = malloc_counted(sizeof(graph_node_t));
+            node->id = GRAPH_NODES + op;
+            for (size_t e = 0; e < GRAPH_EDGES; e++) {
+                node->edges[e] = table[rng_below(GRAPH_NODES)];
+            }
+            table[rng_below(GRAPH_NODES)]->edges[rng_below(GRAPH_EDGES)] = node;
+            size_t victim = rng_below(GRAPH_NODES);
+            free(table[victim]);
+            table[victim] = node;
+        }
+        for (size_t i = 0; i < GRAPH_NODES; i++) {
+            checksum += table[i]->id;
+            free(table[i]);
+        }
+        free(table);
+    } else {
+        object_t *table = gc_new_object(0, GRAPH_NODES);
+        gc_push_root(&table);
+        object_t **slots = gc_object_children(table);
+        for (size_t i = 0; i < GRAPH_NODES; i++) {
+            object_t *node = gc_new_object(sizeof(uint64_t), GRAPH_EDGES);
+            *(uint64_t *)gc_object_data(node) = i;
+            gc_write_barrier_field(table, &slots[i], node);
+        }
+        for (uint64_t op = 0; op < GRAPH_OPS; op++) {
+            object_t *node = gc_new_object(sizeof(uint64_t), GRAPH_EDGES);
+            *(uint64_t *)gc_object_data(node) = GRAPH_NODES + op;
+            for (size_t e = 0; e < GRAPH_EDGES; e++) {
+                gc_write_barrier(node, e, slots[rng_below(GRAPH_NODES)]);
+            }
+            gc_write_barrier(slots[rng_below(GRAPH_NODES)], rng_below(GRAPH_EDGES), node);
+            gc_write_barrier_field(table, &slots[rng_below(GRAPH_NODES)], node);
+        }
+        for (size_t i = 0; i < GRAPH_NODES; i++) {
+            checksum += *(uint64_t *)gc_object_data(slots[i]);
+        }
+        gc_pop_roots(1);
+    }
+
+    // Both versions draw the same random numbers, so they end with the same table
+    static uint64_t expected = 0;
+    if (!expected) {
+        uint64_t saved = rng_state;
+        uint64_t *ids = malloc(sizeof(uint64_t) * GRAPH_NODES);
+        rng_state = 0x9E3779B97F4A7C15ULL;
+        for (size_t i = 0; i < GRAPH_NODES; i++) ids[i] = i;
+        for (uint64_t op = 0; op < GRAPH_OPS; op++) {
+            for (size_t e = 0; e < GRAPH_EDGES; e++) rng_next();
+            rng_next();
+            rng_next();
+            ids[rng_below(GRAPH_NODES)] = GRAPH_NODES + op;
+        }
+        for (size_t i = 0; i < GRAPH_NODES; i++) expected += ids[i];
+        free(ids);
+        rng_state = saved;
+    }
+    return checksum == expected;
+}
+
+/* ========================= MIXED SIZES ========================= */
+
+// A sliding window of live objects, mostly small with an occasional large one,
+// the oldest replaced by each new allocation.
+
+static size_t mixed_size(void) {
+    if (rng_below(MIXED_LARGE_EVERY) == 0) {
+        return MIXED_LARGE_MIN + rng_below(MIXED_LARGE_MAX - MIXED_LARGE_MIN);
+    }
+    return 16 + rng_below(MIXED_SMALL_MAX - 16);
+}
+
+static int run_mixed_sizes(allocator_kind_t kind) {
+    uint64_t checksum = 0, expected = 0;
+    if (kind == USE_MALLOC) {
+        uint64_t **window = calloc(MIXED_WINDOW, sizeof(uint64_t *));
+        for (uint64_t op = 0; op < MIXED_OPS; op++) {
+            size_t slot = op % MIXED_WINDOW;
+            free(window[slot]);
+            window[slot] = malloc_counted(mixed_size());
+            window[slot][0] = op;
+        }
+        for (size_t i = 0; i < MIXED_WINDOW; i++) {
+            checksum += window[i][0];
+            free(window[i]);
+        }
+        free(window);
+    } else {
+        object_t *window = gc_new_object(0, MIXED_WINDOW);
+        gc_push_root(&window);
+        object_t **slots = gc_object_children(window);
+        for (uint64_t op = 0; op < MIXED_OPS; op++) {
+            object_t *obj = gc_new_object(mixed_size(), 0);
+            *(uint64_t *)gc_object_data(obj) = op;
+            gc_write_barrier_field(window, &slots[op % MIXED_WINDOW], obj);
+        }
+        for (size_t i = 0; i < MIXED_WINDOW; i++) {
+            checksum += *(uint64_t *)gc_object_data(slots[i]);
+        }
+        gc_pop_roots(1);
+    }
+
+    for (uint64_t op = MIXED_OPS - MIXED_WINDOW; op < MIXED_OPS; op++) {
+        expected += op;
+    }
+    return checksum == expected;
+}
+
+/* ========================= DRIVER ========================= */
+
+static const struct {
+    const char *name;
+    workload_fn run;
+} workloads[] = {
+    { "binary_trees", run_binary_trees },
+    { "list_churn", run_list_churn },
+    { "graph_mutation", run_graph_mutation },
+    { "mixed_sizes", run_mixed_sizes },
+};
+
+static const char *allocator_names[] = { "gc", "malloc" };
+
+// Runs one workload in the calling process, which is a fresh child.
+static result_t measure(workload_fn run, allocator_kind_t kind) {
+    result_t r;
+    memset(&r, 0, sizeof(r));
+    if (kind == USE_GC) {
+        gc_init();
+        gc_reset_stats();
+    }
+
+    double start = now_ms();
+    r.ok = run(kind);
+    r.elapsed_ms = now_ms() - start;
+    r.allocations = allocations;
+    r.bytes = bytes_allocated;
+
+    if (kind == USE_GC) {
+        gc_stats_t stats;
+        gc_get_stats(&stats);
+        r.collections = stats.collections;
+        r.collection_ms = stats.pause_total_ns / 1e6;
+        r.pause_p50_ns = stats.pause_p50_ns;
+        r.pause_p99_ns = stats.pause_p99_ns;
+        r.pause_p999_ns = stats.pause_p999_ns;
+        r.pause_max_ns = stats.pause_max_ns;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    r.peak_rss_kb = usage.ru_maxrss;
+    return r;
+}
+
+// Forks so every run starts from an empty heap and reports its own peak RSS.
+static int run_isolated(workload_fn run, allocator_kind_t kind, result_t *r) {
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        result_t child = measure(run, kind);
+        ssize_t written = write(fds[1], &child, sizeof(child));
+        _exit(written == (ssize_t)sizeof(child) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], r, sizeof(*r));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return got == (ssize_t)sizeof(*r) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int selected(const char *name, int argc, char **argv) {
+    if (argc <= 2) return 1;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "gcbench.csv";
+    FILE *csv = fopen(path, "w");
+    if (!csv) {
+        perror("Failed to open CSV file");
+        return 1;
+    }
+    fprintf(csv, "workload,allocator,allocations,mb_allocated,elapsed_ms,alloc_rate_mb_s,collections,"
+                 "collection_ms,pause_p50_us,pause_p99_us,pause_p999_us,pause_max_us,peak_rss_kb\n");
+    printf("%-15s %-7s %10s %10s %11s %6s %10s %9s %9s %9s %10s\n", "workload", "alloc", "ms", "MB/s",
+           "peak RSS KB", "GCs", "GC ms", "p50 us", "p99 us", "max us", "vs malloc");
+
+    int failures = 0;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        if (!selected(workloads[w].name, argc, argv)) continue;
+
+        double malloc_ms = 0;
+        for (int kind = USE_MALLOC; kind >= USE_GC; kind--) {
+            result_t r;
+            if (!run_isolated(workloads[w].run, kind, &r) || !r.ok) {
+                fprintf(stderr, "%s with %s failed\n", workloads[w].name, allocator_names[kind]);
+                failures++;
+                continue;
+            }
+
+            double mb = r.bytes / (1024.0 * 1024.0);
+            double rate = r.elapsed_ms > 0 ? mb / (r.elapsed_ms / 1e3) : 0;
+            fprintf(csv, "%s,%s,%llu,%.2f,%.2f,%.2f,%llu,%.2f,%.2f,%.2f,%.2f,%.2f,%ld\n",
+                    workloads[w].name, allocator_names[kind], (unsigned long long)r.allocations, mb,
+                    r.elapsed_ms, rate, (unsigned long long)r.collections, r.collection_ms,
+                    r.pause_p50_ns / 1e3, r.pause_p99_ns / 1e3, r.pause_p999_ns / 1e3,
+                    r.pause_max_ns / 1e3, r.peak_rss_kb);
+
+            if (kind == USE_MALLOC) malloc_ms = r.elapsed_ms;
+            printf("%-15s %-7s %10.1f %10.1f %11ld %6llu %10.1f %9.1f %9.1f %9.1f", workloads[w].name,
+                   allocator_names[kind], r.elapsed_ms, rate, r.peak_rss_kb,
+                   (unsigned long long)r.collections, r.collection_ms, r.pause_p50_ns / 1e3,
+                   r.pause_p99_ns / 1e3, r.pause_max_ns / 1e3);
+            if (kind == USE_GC && malloc_ms > 0) printf(" %9.2fx", r.elapsed_ms / malloc_ms);
+            printf("\n");
+        }
+    }
+
+    fclose(csv);
+    printf("Results written to %s\n", path);
+    return failures ? 1 : 0;
+}
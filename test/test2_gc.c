@@ -4,22 +4,6 @@
 #include <assert.h>
 #include "tb_gc.h"
 
-// Helper function to recover the object header from the user pointer
-
-typedef struct object {
-    size_t size;
-    uint8_t marked;
-    struct object **children;
-    size_t child_count;
-    struct object *next_object;
-} object_t;
-
-/* extern object_t *all_objects; */
-
-object_t *extract_object(void *user_ptr, size_t child_count) {
-    return (object_t *)((uint8_t *)user_ptr - sizeof(object_t) - sizeof(object_t *) * child_count);
-}
-
 void test_object_graph_gc() {
     printf("=== Test: Object Graph GC ===\n");
 
@@ -30,10 +14,10 @@ void test_object_graph_gc() {
     void *c_data = gc_alloc(16, 1);
     void *d_data = gc_alloc(16, 0);
 
-    object_t *a = extract_object(a_data, 1);
-    object_t *b = extract_object(b_data, 1);
-    object_t *c = extract_object(c_data, 1);
-    object_t *d = extract_object(d_data, 0);
+    object_t *a = gc_object_of(a_data);
+    object_t *b = gc_object_of(b_data);
+    object_t *c = gc_object_of(c_data);
+    object_t *d = gc_object_of(d_data);
 
     // Connect the graph
     gc_write_barrier(a, 0, b);
@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include <ctime>
+#include "tb_buddy_arena.hpp"
+#include "tb_allocator.h"
+
+// Exercises BuddyArena instantiations of different shapes: level math checked at
+// compile time, splitting and coalescing back to one block, alignment, and
+// independent instances. Ends with a per-message pool against tb_malloc.
+
+#define MESSAGES 20000
+#define PARTS_PER_MESSAGE 16
+
+typedef BuddyArena<4096, 64, 16> SmallArena;
+typedef BuddyArena<1 << 20, 32, 16> DefaultArena;
+typedef BuddyArena<1 << 16, 256, 64> CacheLineArena;
+
+static_assert(SmallArena::levels == 7, "64 B to 4 KB");
+static_assert(DefaultArena::levels == 16, "same levels as tb_allocator.c");
+static_assert(SmallArena::level_for(1) == 0, "small requests take the smallest block");
+static_assert(SmallArena::level_for(64 - SmallArena::header_size) == 0, "exact fit");
+static_assert(SmallArena::level_for(64 - SmallArena::header_size + 1) == 1, "one byte over");
+static_assert(SmallArena::level_for(SmallArena::max_request) == SmallArena::levels - 1, "whole heap");
+static_assert(CacheLineArena::header_size == 64, "header padded to the alignment");
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void test_split_and_coalesce() {
+    printf("=== Test: Split and Coalesce ===\n");
+    static SmallArena arena;
+
+    void *blocks[4096 / 64 + 1];
+    size_t n = 0;
+    while ((blocks[n] = arena.allocate(1))) {
+        assert(arena.owns(blocks[n]) && (uintptr_t)blocks[n] % 16 == 0);
+        n++;
+    }
+    assert(n == 4096 / 64);
+    assert(!arena.allocate(1));
+
+    // Free in an interleaved order so merges happen at every level
+    for (size_t i = 0; i < n; i += 2) arena.deallocate(blocks[i]);
+    assert(!arena.allocate(SmallArena::block_size(1) - SmallArena::header_size));
+    for (size_t i = 1; i < n; i += 2) arena.deallocate(blocks[i]);
+
+    void *whole = arena.allocate(SmallArena::max_request);
+    assert(whole && arena.usable_size(whole) == SmallArena::max_request);
+    arena.deallocate(whole);
+    printf("%zu blocks merged back into one\n", n);
+}
+
+void test_instances() {
+    printf("=== Test: Independent Instances ===\n");
+    static CacheLineArena a;
+    static CacheLineArena b;
+
+    void *pa = a.allocate(900);
+    void *pb = b.allocate(900);
+    assert(pa && pb && a.owns(pa) && !a.owns(pb) && b.owns(pb));
+    assert((uintptr_t)pa % 64 == 0 && a.usable_size(pa) == 1024 - 64);
+
+    a.reset();
+    assert(a.allocate(CacheLineArena::max_request));
+    assert(!b.allocate(CacheLineArena::max_request));
+    b.deallocate(pb);
+    assert(b.allocate(CacheLineArena::max_request));
+    printf("resetting one arena left the other untouched\n");
+}
+
+// Each message allocates a handful of parts and drops them all at once: from a
+// dedicated arena by reset, against tb_malloc and tb_free one part at a time.
+void bench_messages() {
+    printf("=== Bench: Per-Message Pool ===\n");
+    static SmallArena pool;
+    void *parts[PARTS_PER_MESSAGE];
+
+    double t0 = now_ms();
+    for (int m = 0; m < MESSAGES; m++) {
+        for (int p = 0; p < PARTS_PER_MESSAGE; p++) {
+            parts[p] = pool.allocate(16 + (p * 37) % 150);
+            assert(parts[p]);
+        }
+        pool.reset();
+    }
+    double t1 = now_ms();
+
+    tb_initialize_allocator();
+    for (int m = 0; m < MESSAGES; m++) {
+        for (int p = 0; p < PARTS_PER_MESSAGE; p++) {
+            parts[p] = tb_malloc(16 + (p * 37) % 150);
+            assert(parts[p]);
+        }
+        for (int p = 0; p < PARTS_PER_MESSAGE; p++) {
+            tb_free(parts[p]);
+        }
+    }
+    double t2 = now_ms();
+    printf("arena %8.2f ms  tb_malloc %8.2f ms  (%d messages)\n", t1 - t0, t2 - t1, MESSAGES);
+}
+
+int main() {
+    test_split_and_coalesce();
+    test_instances();
+    bench_messages();
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Finalizers: queued by the collector, run outside its pause by
+// gc_run_finalizers or the finalizer thread.
+
+#define HANDLES 1000
+#define KEPT 100
+#define SLOW_HANDLES 100
+#define SLOW_FINALIZER_US 500
+
+// A "file handle": its descriptor, and a child holding the path it was opened with
+typedef struct {
+    long fd;
+} handle_t;
+
+static int closed[HANDLES];
+static volatile int closed_count = 0;
+
+static void close_handle(void *data) {
+    handle_t *handle = data;
+    object_t *path = gc_get_child(gc_object_of(handle), 0);
+
+    // Whatever the handle refers to is still intact when its finalizer runs
+    assert(path && *(long *)gc_object_data(path) == -handle->fd);
+    assert(!closed[handle->fd]);
+    closed[handle->fd] = 1;
+    __atomic_fetch_add(&closed_count, 1, __ATOMIC_RELAXED);
+}
+
+static object_t *open_handle(long fd) {
+    handle_t *handle = gc_alloc_finalizable(sizeof(handle_t), 1, close_handle);
+    assert(handle);
+    handle->fd = fd;
+    long *path = gc_alloc(sizeof(long), 0);
+    *path = -fd;
+    gc_write_barrier(gc_object_of(handle), 0, gc_object_of(path));
+    return gc_object_of(handle);
+}
+
+static void reset_closed(void) {
+    for (int i = 0; i < HANDLES; i++) closed[i] = 0;
+    closed_count = 0;
+}
+
+// Opens HANDLES handles and keeps every (HANDLES / KEPT)th one in holder
+static object_t *open_handles(void) {
+    object_t *holder = gc_object_of(gc_alloc(0, KEPT));
+    gc_add_root(holder);
+    for (long fd = 0; fd < HANDLES; fd++) {
+        object_t *handle = open_handle(fd);
+        if (fd % (HANDLES / KEPT) == 0) {
+            gc_write_barrier(holder, fd / (HANDLES / KEPT), handle);
+        }
+    }
+    return holder;
+}
+
+void test_explicit(gc_mode_t mode, const char *name) {
+    printf("=== Test: Explicit Finalization (%s) ===\n", name);
+    gc_init_mode(mode);
+    gc_reset_stats();
+    reset_closed();
+    object_t *holder = open_handles();
+
+    // The collection only queues; nothing has run yet
+    gc_collect_full();
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.finalizers_queued == HANDLES - KEPT && closed_count == 0);
+
+    holder = gc_forward(holder);
+    assert(gc_run_finalizers() == HANDLES - KEPT);
+    assert(closed_count == HANDLES - KEPT);
+    for (int fd = 0; fd < HANDLES; fd++) {
+        assert(closed[fd] == (fd % (HANDLES / KEPT) != 0));
+    }
+
+    // Finalized objects are freed by the next collection, and never queued again
+    uint64_t freed = stats.objects_freed;
+    gc_collect_full();
+    gc_get_stats(&stats);
+    assert(stats.objects_freed - freed >= 2 * (HANDLES - KEPT));
+    assert(gc_run_finalizers() == 0);
+    printf("%d handles closed, %d still open\n", closed_count, KEPT);
+
+    gc_remove_root(gc_forward(holder));
+    gc_collect_full();
+    assert(gc_run_finalizers() == KEPT && closed_count == HANDLES);
+}
+
+void test_background_thread() {
+    printf("=== Test: Finalizer Thread ===\n");
+    gc_init();
+    gc_reset_stats();
+    reset_closed();
+    assert(gc_finalizer_thread_start());
+
+    object_t *holder = open_handles();
+    gc_collect_full();
+    for (int i = 0; i < 2000 && closed_count < HANDLES - KEPT; i++) {
+        usleep(1000);
+    }
+    assert(closed_count == HANDLES - KEPT);
+
+    gc_finalizer_thread_stop();
+    gc_remove_root(holder);
+    printf("finalizer thread closed %d handles\n", closed_count);
+}
+
+static volatile int slow_count = 0;
+
+static void slow_finalizer(void *data) {
+    (void)data;
+    usleep(SLOW_FINALIZER_US);
+    __atomic_fetch_add(&slow_count, 1, __ATOMIC_RELAXED);
+}
+
+// However long finalizers take, none of it happens inside a pause
+void test_bounded_pause() {
+    printf("=== Test: Bounded Pause ===\n");
+    gc_init();
+    gc_reset_stats();
+    assert(gc_finalizer_thread_start());
+
+    for (int i = 0; i < SLOW_HANDLES; i++) {
+        assert(gc_alloc_finalizable(16, 0, slow_finalizer));
+    }
+    gc_collect_full();
+    for (int i = 0; i < 2000 && slow_count < SLOW_HANDLES; i++) {
+        usleep(1000);
+    }
+    gc_finalizer_thread_stop();
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(slow_count == SLOW_HANDLES && stats.finalizers_run == SLOW_HANDLES);
+    assert(stats.pause_max_ns < (uint64_t)SLOW_HANDLES * SLOW_FINALIZER_US * 1000 / 10);
+    printf("%d ms of finalizers, longest pause %.1f us\n",
+           SLOW_HANDLES * SLOW_FINALIZER_US / 1000, stats.pause_max_ns / 1e3);
+}
+
+int main() {
+    test_explicit(GC_MODE_MARK_SWEEP, "mark-sweep");
+    test_explicit(GC_MODE_SEMISPACE, "semispace");
+    test_background_thread();
+    test_bounded_pause();
+    return 0;
+}
@@ -17,7 +17,7 @@ void test_basic_gc() {
     root->child = NULL;
 
     // Add as root
-    gc_add_root((object_t *)root);
+    gc_add_root(gc_object_of(root));
 
     // Allocate a child object (with explicit cast)
     example_data *child = (example_data *)gc_alloc(sizeof(example_data), 0);
@@ -26,7 +26,7 @@ void test_basic_gc() {
     child->child = NULL;
 
     // Link child to root (using write barrier)
-    gc_write_barrier((object_t *)root, 0, (object_t *)child);
+    gc_write_barrier(gc_object_of(root), 0, gc_object_of(child));
 
     printf("Root: %d, Child: %d\n", root->value, child->value);
 
@@ -35,29 +35,48 @@ void test_basic_gc() {
     printf("After GC (both objects retained)\n");
 
     // Remove child reference and collect again (child should be freed)
-    gc_write_barrier((object_t *)root, 0, NULL);
+    gc_write_barrier(gc_object_of(root), 0, NULL);
     gc_collect_full();
     printf("After GC (child freed)\n");
 
     // Clean up
-    gc_remove_root((object_t *)root);
+    gc_remove_root(gc_object_of(root));
     gc_collect_full();
 }
 
+// Objects are bump-allocated from per-thread chunks, so a dead object's slot is
+// not handed out again while its chunk is still the thread's TLAB. Memory comes
+// back a chunk at a time: once the TLAB has moved on and everything in the old
+// chunk is dead, the chunk is freed and a later refill can take it again.
+#define REUSE_OBJECT 128
+#define REUSE_LIMIT 16384
+
 void test_memory_reuse() {
     printf("\n=== Testing Memory Reuse ===\n");
-    void *ptr1 = gc_alloc(128, 0);
+    char *ptr1 = gc_alloc(REUSE_OBJECT, 0);
     assert(ptr1 != NULL);
-    printf("Allocated 128 bytes at %p\n", ptr1);
+    printf("Allocated %d bytes at %p\n", REUSE_OBJECT, (void *)ptr1);
+
+    // Fill the rest of ptr1's chunk; the TLAB moves on at the first jump in address
+    char *last = ptr1, *ptr;
+    while ((ptr = gc_alloc(REUSE_OBJECT, 0)) > last && ptr <= last + 2 * REUSE_OBJECT) {
+        last = ptr;
+    }
+    assert(ptr != NULL);
 
-    gc_collect_full();  // No roots, so ptr1 should be freed
+    gc_collect_full();  // No roots, so the whole of ptr1's chunk is garbage
 
-    void *ptr2 = gc_alloc(128, 0);
-    assert(ptr2 != NULL);
-    printf("Allocated another 128 bytes at %p\n", ptr2);
+    // A later refill takes the freed chunk again
+    int reused = 0;
+    for (int i = 0; i < REUSE_LIMIT && !reused; i++) {
+        ptr = gc_alloc(REUSE_OBJECT, 0);
+        assert(ptr != NULL);
+        reused = ptr >= ptr1 && ptr <= last;
+    }
+    printf("Allocated another %d bytes at %p\n", REUSE_OBJECT, (void *)ptr);
 
-    // If memory is reused, ptr2 == ptr1
-    printf("Memory %s reused\n", ptr1 == ptr2 ? "was" : "was not");
+    printf("Memory %s reused\n", reused ? "was" : "was not");
+    assert(reused);
 }
 
 int main() {
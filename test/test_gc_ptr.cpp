@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstddef>
+#include <cassert>
+#include "tb_gc.hpp"
+
+// Exercises the C++ interface: pointer maps computed at compile time, gc_new
+// with constructor arguments, and gc_ptr stores that apply the write barrier
+// during incremental marking and promote region objects that escape.
+
+#define CHAIN_LENGTH 20000
+#define TREE_DEPTH 12
+
+struct Node {
+    gc_ptr<Node> left;
+    gc_ptr<Node> right;
+    long value;
+
+    explicit Node(long v) : value(v) {}
+    Node(long v, gc_ptr<Node> l, gc_ptr<Node> r) : left(l), right(r), value(v) {}
+};
+template <> struct gc_layout<Node> : gc_fields<offsetof(Node, left), offsetof(Node, right)> {};
+
+// A pointer past the first 64 words, so the collector uses the offset list
+struct Wide {
+    long pad[80];
+    gc_ptr<Node> far;
+};
+template <> struct gc_layout<Wide> : gc_fields<offsetof(Wide, far)> {};
+
+struct Plain {
+    double x, y;
+};
+
+static_assert(gc_layout<Node>::bitmap == 0x3, "left and right are words 0 and 1");
+static_assert(gc_layout<Node>::fits_bitmap && !gc_layout<Wide>::fits_bitmap, "scan kinds");
+static_assert(gc_layout<Plain>::count == 0, "pointer-free by default");
+
+static gc_ptr<Node> build_tree(int depth) {
+    if (depth == 0) return gc_new<Node>(0);
+    gc_root<Node> left(build_tree(depth - 1));
+    gc_root<Node> right(build_tree(depth - 1));
+    return gc_new<Node>(depth, left.get(), right.get());
+}
+
+static size_t count_nodes(const gc_ptr<Node> &node) {
+    return node ? 1 + count_nodes(node->left) + count_nodes(node->right) : 0;
+}
+
+void test_tree() {
+    printf("=== Test: Tree Through gc_new ===\n");
+    gc_init();
+
+    gc_root<Node> tree(build_tree(TREE_DEPTH));
+    gc_ptr<Node> garbage = build_tree(TREE_DEPTH - 2);
+    gc_collect_full();
+
+    assert(count_nodes(tree.get()) == (1u << (TREE_DEPTH + 1)) - 1);
+    assert(tree->value == TREE_DEPTH && !findObj(garbage.object()));
+    printf("tree of %zu nodes survived, unrooted subtree was freed\n", count_nodes(tree.get()));
+
+    gc_root<Wide> wide(gc_new<Wide>());
+    wide->far = gc_new<Node>(7);
+    gc_collect_full();
+    assert(wide->far && wide->far->value == 7);
+    printf("pointer beyond the bitmap was scanned\n");
+
+    gc_ptr<Plain> plain = gc_new<Plain>(Plain{ 1.5, 2.5 });
+    assert(plain->x == 1.5 && plain->y == 2.5);
+}
+
+// Moves a leaf from the far end of a long chain into a root the marker has already
+// scanned; only the barrier on the gc_ptr store keeps the leaf alive.
+void test_barrier() {
+    printf("=== Test: Barrier on Assignment ===\n");
+    gc_init();
+
+    gc_root<Node> holder(gc_new<Node>(-1));
+    gc_root<Node> chain(gc_new<Node>(0));
+    gc_ptr<Node> tail = chain.get();
+    for (long i = 1; i < CHAIN_LENGTH; i++) {
+        tail->left = gc_new<Node>(i);
+        tail = tail->left;
+    }
+    tail->right = gc_new<Node>(42);
+
+    assert(gc_collect_step() == 0);
+    holder->right = tail->right;
+    tail->right = nullptr;
+    while (!gc_collect_step()) {
+    }
+
+    assert(findObj(holder->right.object()) && holder->right->value == 42);
+    printf("leaf moved behind the marker survived the cycle\n");
+}
+
+void test_region_escape() {
+    printf("=== Test: Region Escape ===\n");
+    gc_init();
+
+    gc_root<Node> holder(gc_new<Node>(0));
+    assert(gc_region_begin());
+    holder->left = gc_new<Node>(1, gc_new<Node>(2), gc_ptr<Node>());
+    gc_ptr<Node> scratch = gc_new<Node>(3);
+    gc_region_end();
+
+    assert(!findObj(scratch.object()));
+    gc_collect_full();
+    assert(holder->left->value == 1 && holder->left->left->value == 2);
+    printf("stored object and its child were promoted, scratch was released\n");
+}
+
+int main() {
+    test_tree();
+    test_barrier();
+    test_region_escape();
+    return 0;
+}
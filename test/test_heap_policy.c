@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Automatic collection: the allocation-threshold trigger, collect-and-retry on
+// allocation failure, and heap growth when the live set outgrows the heap.
+
+#define HEAP_BYTES (1 << 20)
+#define GARBAGE_OBJECTS 200000
+#define LIVE_NODES 40000
+
+// Without any explicit collection, churning through many heaps' worth of
+// garbage has to be kept afloat by the trigger alone.
+void test_threshold_trigger() {
+    printf("=== Test: Threshold Trigger ===\n");
+    gc_init();
+    gc_reset_stats();
+
+    for (int i = 0; i < GARBAGE_OBJECTS; i++) {
+        assert(gc_alloc(48, 2));
+    }
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.triggered_collections > 0);
+    printf("%llu triggered collections, %llu after failures, goal %zu KB\n",
+           (unsigned long long)stats.triggered_collections,
+           (unsigned long long)stats.failure_collections, stats.heap_goal_bytes / 1024);
+}
+
+// With the goal pushed to the heap limit the trigger never fires, so an
+// allocation that finds the heap full collects and retries instead of failing.
+void test_collect_and_retry() {
+    printf("=== Test: Collect and Retry ===\n");
+    gc_init();
+    gc_reset_stats();
+
+    // A small live set over a tiny live ratio puts the goal at max_heap_bytes
+    object_t *live = gc_object_of(gc_alloc(0, 1024));
+    gc_add_root(live);
+    for (int i = 0; i < 1024; i++) {
+        gc_write_barrier(live, i, gc_object_of(gc_alloc(64, 0)));
+    }
+    gc_heap_policy_t policy = { .auto_collect = 1, .target_live_ratio = 0.01, .max_heap_bytes = HEAP_BYTES };
+    gc_set_heap_policy(&policy);
+    gc_collect_full();
+
+    for (int i = 0; i < GARBAGE_OBJECTS; i++) {
+        assert(gc_alloc(48, 2));
+    }
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.failure_collections > 0 && stats.heap_capacity_bytes == HEAP_BYTES);
+    printf("%llu collections after allocation failures\n", (unsigned long long)stats.failure_collections);
+
+    // And with the policy off, a full heap is reported as before
+    policy.auto_collect = 0;
+    gc_set_heap_policy(&policy);
+    int failed = 0;
+    for (int i = 0; i < GARBAGE_OBJECTS && !failed; i++) {
+        failed = gc_alloc(48, 2) == NULL;
+    }
+    assert(failed);
+    printf("allocation fails once auto_collect is off\n");
+    gc_remove_root(live);
+    gc_set_heap_policy(NULL);
+}
+
+// A rooted list larger than the initial heap: the heap has to grow to hold it.
+void test_heap_growth() {
+    printf("=== Test: Heap Growth ===\n");
+    gc_init();
+    gc_reset_stats();
+
+    object_t *head = NULL;
+    gc_push_root(&head);
+    for (long i = 0; i < LIVE_NODES; i++) {
+        long *data = gc_alloc(sizeof(long), 1);
+        assert(data);
+        *data = i;
+        object_t *node = gc_object_of(data);
+        gc_write_barrier(node, 0, head);
+        head = node;
+
+        // Garbage alongside, so collections have something to reclaim
+        assert(gc_alloc(32, 0));
+    }
+
+    long expected = LIVE_NODES;
+    for (object_t *node = head; node; node = gc_get_child(node, 0)) {
+        assert(*(long *)gc_object_data(node) == --expected);
+    }
+    assert(expected == 0);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.heap_capacity_bytes > HEAP_BYTES);
+    printf("heap grew to %zu KB for %zu KB of chunks; goal %zu KB\n",
+           stats.heap_capacity_bytes / 1024, stats.heap_bytes / 1024, stats.heap_goal_bytes / 1024);
+
+    gc_pop_roots(1);
+}
+
+int main() {
+    // Arenas outlive gc_init, so run this while the heap is still one arena
+    test_collect_and_retry();
+    test_threshold_trigger();
+    test_heap_growth();
+    return 0;
+}
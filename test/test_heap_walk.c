@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "tb_allocator.h"
+
+// Exercises tb_allocator_next_block: a heap with a known mix of used and free
+// blocks, spread over a second arena after the heap grows, is walked visiting
+// every allocated block exactly once in ascending address order, with oversized
+// blocks last. Ends with walks racing threads that split and merge blocks.
+
+#define HEADER_ROOM 64  // More than a block header, so a request fills its block's level
+#define MAX_LIVE 4096
+#define CHURN_THREADS 3
+#define CHURN_ROUNDS 200000
+#define PINNED 32
+
+static void *live[MAX_LIVE];
+static size_t live_count;
+
+static void *take(tb_allocator_t *allocator, size_t size) {
+    void *ptr = tb_allocator_malloc(allocator, size);
+    assert(ptr && live_count < MAX_LIVE);
+    live[live_count++] = ptr;
+    return ptr;
+}
+
+static void drop(size_t i) {
+    tb_free(live[i]);
+    live[i] = live[--live_count];
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) * (void *const *)a;
+    uintptr_t y = (uintptr_t) * (void *const *)b;
+    return (x > y) - (x < y);
+}
+
+// Walks the whole heap and checks it against the live set.
+static void check_walk(tb_allocator_t *allocator, void *oversized) {
+    qsort(live, live_count, sizeof(void *), compare_addresses);
+
+    size_t visited = 0;
+    for (void *block = tb_allocator_next_block(allocator, NULL); block;
+         block = tb_allocator_next_block(allocator, block)) {
+        if (block == oversized) {
+            assert(visited == live_count);
+            continue;
+        }
+        // Every block is the next live one by address, so none is missed or repeated
+        assert(visited < live_count && block == live[visited]);
+        if (visited > 0) {
+            // The previous block ends where this one's header starts
+            assert((uint8_t *)live[visited - 1] + tb_usable_size(live[visited - 1]) < (uint8_t *)block);
+        }
+        visited++;
+    }
+    assert(visited == live_count);
+}
+
+void test_known_heap() {
+    printf("=== Test: Known Heap ===\n");
+    tb_allocator_t *allocator = tb_allocator_create();
+    assert(allocator);
+
+    // Fill the first arena with 64 KB blocks and free every other one; their
+    // buddies stay allocated, so the holes cannot merge
+    for (int i = 0; i < 16; i++) {
+        take(allocator, 64 * 1024 - HEADER_ROOM);
+    }
+    assert(!tb_allocator_malloc(allocator, 32));
+    for (size_t i = 0; i < live_count; i++) {
+        if ((uintptr_t)live[i] / (64 * 1024) % 2) drop(i--);
+    }
+    assert(live_count == 8);
+
+    // Small blocks of mixed sizes in some holes, with a few freed again
+    for (int i = 0; i < 300; i++) {
+        take(allocator, 16 + (size_t)(i * 37) % 900);
+    }
+    for (size_t i = 8; i < live_count; i += 3) {
+        drop(i);
+    }
+    check_walk(allocator, NULL);
+    printf("one arena: %zu blocks\n", live_count);
+
+    // 128 KB blocks no longer fit the first arena, so these land in the second
+    assert(tb_allocator_grow(allocator) && tb_allocator_capacity(allocator) == 2 * HEAP_SIZE);
+    size_t first_new = live_count;
+    for (int i = 0; i < 6; i++) {
+        take(allocator, 128 * 1024 - HEADER_ROOM);
+    }
+    drop(first_new + 1);
+    drop(first_new + 3);
+    for (int i = 0; i < 200; i++) {
+        take(allocator, 16 + (size_t)(i * 53) % 2000);
+    }
+    void *oversized = tb_allocator_malloc(allocator, 2 * HEAP_SIZE);
+    assert(oversized);
+    check_walk(allocator, oversized);
+    printf("two arenas: %zu blocks, then the oversized one\n", live_count);
+
+    while (live_count) {
+        drop(live_count - 1);
+    }
+    tb_free(oversized);
+    assert(!tb_allocator_next_block(allocator, NULL));
+    tb_allocator_destroy(allocator);
+}
+
+typedef struct {
+    tb_allocator_t *allocator;
+    unsigned seed;
+} churn_t;
+
+static int churning;  // Churn threads still running
+
+// Splits and merges blocks as fast as it can, never freeing the pinned ones
+static void *churn_main(void *arg) {
+    churn_t *c = arg;
+    void *slots[64] = { NULL };
+    for (int r = 0; r < CHURN_ROUNDS; r++) {
+        int s = rand_r(&c->seed) % 64;
+        if (slots[s]) {
+            tb_free(slots[s]);
+            slots[s] = NULL;
+        } else {
+            slots[s] = tb_allocator_malloc(c->allocator, 16 + rand_r(&c->seed) % 4000);
+        }
+    }
+    for (int s = 0; s < 64; s++) {
+        tb_free(slots[s]);
+    }
+    __atomic_fetch_sub(&churning, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Steps only ever start from a pinned block, since prev must stay allocated, but
+// each scans forward through blocks being split and merged meanwhile and must land
+// no further than the next pinned one.
+void test_concurrent_walk() {
+    printf("=== Test: Walking During Splits and Merges ===\n");
+    tb_allocator_t *allocator = tb_allocator_create();
+    // Pinned blocks are spread out, leaving free space between them to churn in
+    void *pinned[PINNED];
+    void *spacers[PINNED * 8];
+    for (int i = 0; i < PINNED * 8; i++) {
+        spacers[i] = tb_allocator_malloc(allocator, 16 + (size_t)(i * 300) % 4000);
+        assert(spacers[i]);
+        if (i % 8 == 0) pinned[i / 8] = spacers[i];
+    }
+    for (int i = 0; i < PINNED * 8; i++) {
+        if (i % 8) tb_free(spacers[i]);
+    }
+    qsort(pinned, PINNED, sizeof(void *), compare_addresses);
+
+    pthread_t threads[CHURN_THREADS];
+    churn_t churn[CHURN_THREADS];
+    churning = CHURN_THREADS;
+    for (int t = 0; t < CHURN_THREADS; t++) {
+        churn[t].allocator = allocator;
+        churn[t].seed = (unsigned)t + 1;
+        pthread_create(&threads[t], NULL, churn_main, &churn[t]);
+    }
+
+    size_t walks = 0;
+    for (; __atomic_load_n(&churning, __ATOMIC_ACQUIRE); walks++) {
+        void *block = tb_allocator_next_block(allocator, NULL);
+        assert(block && (uintptr_t)block <= (uintptr_t)pinned[0]);
+        for (int i = 0; i + 1 < PINNED; i++) {
+            block = tb_allocator_next_block(allocator, pinned[i]);
+            assert((uintptr_t)block > (uintptr_t)pinned[i] && (uintptr_t)block <= (uintptr_t)pinned[i + 1]);
+        }
+    }
+
+    for (int t = 0; t < CHURN_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    for (int i = 0; i < PINNED; i++) {
+        tb_free(pinned[i]);
+    }
+    tb_allocator_destroy(allocator);
+    printf("%zu walks stepped between pinned blocks in order\n", walks);
+}
+
+int main() {
+    test_known_heap();
+    test_concurrent_walk();
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Exercises independent heaps: separate roots and statistics, collecting one
+// heap without touching another, concurrent collections on two threads, and
+// destroying a heap while the default one carries on.
+
+#define LIST_LENGTH 2000
+#define THREAD_ROUNDS 20
+#define LARGE_BYTES (256 * 1024)
+
+// The list is on the shadow stack only while it is being built, since a
+// collection may run inside gc_alloc.
+static object_t *build_list(size_t n) {
+    object_t *head = NULL;
+    gc_push_root(&head);
+    for (size_t i = 0; i < n; i++) {
+        object_t *node = gc_object_of(gc_alloc(16, 1));
+        assert(node);
+        *(uint64_t *)gc_object_data(node) = i;
+        gc_write_barrier(node, 0, head);
+        head = node;
+    }
+    gc_pop_roots(1);
+    return head;
+}
+
+static size_t list_length(object_t *head) {
+    size_t n = 0;
+    for (; head; head = gc_get_child(head, 0)) {
+        n++;
+    }
+    return n;
+}
+
+void test_independent_roots() {
+    printf("=== Test: Independent Roots ===\n");
+    gc_init();
+    gc_heap_t *a = gc_heap_create();
+    gc_heap_t *b = gc_heap_create();
+    assert(a && b && a != b && gc_default_heap() != a);
+
+    object_t *in_a = gc_object_of(gc_heap_alloc(a, 8, 0));
+    object_t *in_b = gc_object_of(gc_heap_alloc(b, 8, 0));
+    gc_heap_add_root(a, in_a);
+
+    // b has no roots, so collecting it frees its object and leaves a's alone
+    gc_heap_collect(b);
+    assert(findObj(in_a) && !findObj(in_b));
+
+    gc_stats_t sa, sb, sd;
+    gc_heap_get_stats(a, &sa);
+    gc_heap_get_stats(b, &sb);
+    gc_get_stats(&sd);
+    assert(sa.collections == 0 && sb.collections == 1 && sd.collections == 0);
+    assert(sb.objects_freed == 1);
+
+    gc_heap_remove_root(a, in_a);
+    gc_heap_collect(a);
+    assert(!findObj(in_a));
+    printf("each heap kept only its own roots\n");
+
+    gc_heap_destroy(a);
+    gc_heap_destroy(b);
+}
+
+void test_use() {
+    printf("=== Test: Switching Heaps ===\n");
+    gc_init();
+    object_t *kept = build_list(LIST_LENGTH);
+    gc_add_root(kept);
+
+    gc_heap_t *h = gc_heap_create();
+    gc_heap_t *prev = gc_heap_use(h);
+    assert(prev == gc_default_heap());
+    object_t *local = build_list(LIST_LENGTH);
+    object_t *holder = NULL;
+    gc_push_root(&holder);
+    holder = local;
+    build_list(LIST_LENGTH);
+    gc_collect_full();
+    assert(list_length(holder) == LIST_LENGTH);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.objects_freed == LIST_LENGTH);
+    gc_pop_roots(1);
+    gc_heap_use(prev);
+
+    // The default heap's cycle runs without the other heap's shadow stack
+    gc_collect_full();
+    assert(list_length(kept) == LIST_LENGTH);
+    assert(findObj(local));
+    printf("the shadow stack root belonged to the heap it was pushed in\n");
+
+    gc_heap_destroy(h);
+    assert(!findObj(local));
+    gc_remove_root(kept);
+}
+
+typedef struct {
+    gc_heap_t *heap;
+    size_t survivors;
+} worker_t;
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    gc_heap_use(w->heap);
+    object_t *live = build_list(LIST_LENGTH);
+    gc_add_root(live);
+    for (int r = 0; r < THREAD_ROUNDS; r++) {
+        build_list(LIST_LENGTH);
+        gc_collect_full();
+    }
+    w->survivors = list_length(live);
+    gc_remove_root(live);
+    return NULL;
+}
+
+void test_concurrent_collection() {
+    printf("=== Test: Concurrent Collection ===\n");
+    gc_init();
+    worker_t workers[2];
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        workers[i].heap = gc_heap_create();
+        workers[i].survivors = 0;
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        assert(workers[i].survivors == LIST_LENGTH);
+
+        gc_stats_t stats;
+        gc_heap_get_stats(workers[i].heap, &stats);
+        assert(stats.collections >= THREAD_ROUNDS);
+        printf("heap %d: %llu collections, %llu objects freed\n", i,
+               (unsigned long long)stats.collections, (unsigned long long)stats.objects_freed);
+        gc_heap_destroy(workers[i].heap);
+    }
+}
+
+void test_destroy_current() {
+    printf("=== Test: Destroying the Current Heap ===\n");
+    gc_init();
+    gc_heap_t *h = gc_heap_create();
+    gc_heap_use(h);
+    object_t *big = gc_object_of(gc_alloc(64 * 1024, 0));
+    gc_add_root(big);
+    gc_heap_destroy(h);
+    assert(!findObj(big));
+
+    // Back on the default heap, which is untouched
+    object_t *obj = gc_object_of(gc_alloc(8, 0));
+    gc_add_root(obj);
+    gc_collect_full();
+    assert(findObj(obj));
+    gc_remove_root(obj);
+    printf("destroyed heap released its objects, including large ones\n");
+}
+
+// Mappings are unmapped by a shared background thread, which must credit the
+// heap the objects came from rather than its own.
+void test_large_unmap_stats() {
+    printf("=== Test: Unmapped Bytes Per Heap ===\n");
+    gc_init();
+    gc_release_large_cache();
+    gc_stats_t before, stats;
+    gc_get_stats(&before);
+
+    // Rooted until all are allocated, so no collection recycles one for the next
+    gc_heap_t *h = gc_heap_create();
+    object_t *large[4];
+    for (int i = 0; i < 4; i++) {
+        large[i] = gc_object_of(gc_heap_alloc(h, LARGE_BYTES, 0));
+        assert(large[i]);
+        gc_heap_add_root(h, large[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        gc_heap_remove_root(h, large[i]);
+    }
+    gc_heap_collect(h);
+    gc_release_large_cache();
+    for (int i = 0; i < 1000; i++) {
+        gc_heap_get_stats(h, &stats);
+        if (stats.large_bytes_unmapped >= 4 * LARGE_BYTES) break;
+        usleep(1000);
+    }
+    assert(stats.large_bytes_unmapped >= 4 * LARGE_BYTES);
+
+    gc_stats_t after;
+    gc_get_stats(&after);
+    assert(after.large_bytes_unmapped == before.large_bytes_unmapped);
+    printf("%llu bytes credited to the heap that owned them\n", (unsigned long long)stats.large_bytes_unmapped);
+    gc_heap_destroy(h);
+}
+
+int main() {
+    test_independent_roots();
+    test_use();
+    test_concurrent_collection();
+    test_destroy_current();
+    test_large_unmap_stats();
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Exercises the mark stack on shapes that used to lose work when the
+// fixed-size stack overflowed: a long chain and a very wide fan-out.
+
+#define CHAIN_LENGTH 4000
+#define FAN_OUT 4500
+
+void test_deep_chain() {
+    printf("=== Test: Deep Chain ===\n");
+    gc_init();
+
+    object_t *head = gc_object_of(gc_alloc(8, 1));
+    object_t *tail = head;
+    for (int i = 1; i < CHAIN_LENGTH; i++) {
+        object_t *node = gc_object_of(gc_alloc(8, 1));
+        gc_write_barrier(tail, 0, node);
+        tail = node;
+    }
+    gc_add_root(head);
+
+    gc_collect_full();
+    assert(findObj(tail));
+    printf("tail alive? yes\n");
+
+    gc_remove_root(head);
+    gc_collect_full();
+    assert(!findObj(head) && !findObj(tail));
+    printf("chain collected after unrooting\n");
+}
+
+// Every leaf hangs off a distinct child of the root, so the stack holds
+// FAN_OUT entries at once - more than the preallocated segment pool.
+void test_wide_fan_out() {
+    printf("=== Test: Wide Fan-Out ===\n");
+    gc_init();
+
+    object_t *root = gc_object_of(gc_alloc(0, FAN_OUT));
+    object_t *leaves[FAN_OUT];
+    for (int i = 0; i < FAN_OUT; i++) {
+        object_t *mid = gc_object_of(gc_alloc(0, 1));
+        leaves[i] = gc_object_of(gc_alloc(0, 0));
+        gc_write_barrier(mid, 0, leaves[i]);
+        gc_write_barrier(root, i, mid);
+    }
+    gc_add_root(root);
+
+    gc_collect_full();
+    for (int i = 0; i < FAN_OUT; i++) {
+        assert(findObj(leaves[i]));
+    }
+    printf("all %d leaves alive\n", FAN_OUT);
+}
+
+int main() {
+    test_deep_chain();
+    test_wide_fan_out();
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Preemptible collection: a predicate polled while marking and sweeping stops
+// the cycle at a consistent point, and the cycle resumes where it left off.
+
+#define LIVE_NODES 20000
+#define GARBAGE_NODES 20000
+#define MAX_WAIT_NS 200000ULL
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// A rooted list of LIVE_NODES nodes holding their index, and as much garbage
+static object_t *build_heap(void) {
+    object_t *head = gc_object_of(gc_alloc(sizeof(long), 1));
+    gc_add_root(head);
+    object_t *tail = head;
+    *(long *)gc_object_data(head) = 0;
+    for (long i = 1; i < LIVE_NODES; i++) {
+        object_t *node = gc_object_of(gc_alloc(sizeof(long), 1));
+        *(long *)gc_object_data(node) = i;
+        gc_write_barrier(tail, 0, node);
+        tail = node;
+        gc_alloc(sizeof(long), 1);
+    }
+    return head;
+}
+
+static void check_list(object_t *head) {
+    long expected = 0;
+    for (object_t *node = head; node; node = gc_get_child(node, 0)) {
+        assert(*(long *)gc_object_data(node) == expected++);
+    }
+    assert(expected == LIVE_NODES);
+}
+
+// Fires on every fifth poll
+static int polls = 0;
+
+static int every_fifth_poll(void *arg) {
+    (void)arg;
+    return ++polls % 5 == 0;
+}
+
+void test_resume_after_yield() {
+    printf("=== Test: Resume After Yield ===\n");
+    gc_init();
+    gc_reset_stats();
+    gc_heap_policy_t manual = { .auto_collect = 0, .max_heap_bytes = 1 << 20 };
+    gc_set_heap_policy(&manual);
+    object_t *head = build_heap();
+
+    gc_preemption_config_t config = { .critical_event_pending = every_fifth_poll };
+    gc_set_preemption(&config);
+
+    int yields = 0;
+    gc_status_t status;
+    while ((status = gc_collect_preemptible()) == GC_YIELD_CRITICAL) {
+        yields++;
+        check_list(head);
+    }
+    assert(status == GC_CYCLE_COMPLETE);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(yields > 1 && stats.collections == 1);
+    assert(stats.objects_freed >= GARBAGE_NODES - 1);
+    check_list(head);
+    printf("cycle completed after %d yields, %llu objects freed\n", yields, (unsigned long long)stats.objects_freed);
+
+    gc_set_preemption(NULL);
+    gc_remove_root(head);
+    gc_set_heap_policy(NULL);
+}
+
+static int always(void *arg) {
+    (void)arg;
+    return 1;
+}
+
+// With an event already waiting, a slice that can return does no work at all
+void test_pending_at_entry() {
+    printf("=== Test: Pending At Entry ===\n");
+    gc_init();
+    gc_reset_stats();
+
+    gc_preemption_config_t config = { .critical_event_pending = always };
+    gc_set_preemption(&config);
+    assert(gc_collect_preemptible() == GC_YIELD_CRITICAL);
+    assert(gc_collect_step() == 0);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.collections == 0 && stats.pause_count == 0 && stats.preemptions == 2);
+    gc_set_preemption(NULL);
+    printf("no work done while an event was pending\n");
+}
+
+// Events fall due at fixed times during full collections, which cannot return,
+// so each is run from emergency_yield between two pauses. The wait from the due
+// time until then depends on the machine, so it is reported rather than checked.
+typedef struct {
+    uint64_t due;
+    uint64_t max_wait;
+    int handled;
+} event_source_t;
+
+static int event_due(void *arg) {
+    event_source_t *events = arg;
+    return now_ns() >= events->due;
+}
+
+static void run_event(void *arg) {
+    event_source_t *events = arg;
+    uint64_t now = now_ns();
+    if (now - events->due > events->max_wait) events->max_wait = now - events->due;
+    events->handled++;
+    events->due = now + 50000;
+}
+
+void test_bounded_wait() {
+    printf("=== Test: Bounded Wait ===\n");
+    gc_init();
+    object_t *head = build_heap();
+    gc_reset_stats();
+
+    event_source_t events = { now_ns() + 50000, 0, 0 };
+    gc_preemption_config_t config = {
+        .critical_event_pending = event_due,
+        .emergency_yield = run_event,
+        .arg = &events,
+        .max_wait_ns = MAX_WAIT_NS,
+    };
+    gc_set_preemption(&config);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < 20; i++) {
+        gc_collect_full();
+    }
+    uint64_t elapsed = now_ns() - start;
+    gc_set_preemption(NULL);
+    check_list(head);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    printf("%d events in %.1f ms of collection; longest wait %.1f us, longest poll gap %.1f us (bound %.0f us)\n",
+           events.handled, elapsed / 1e6, events.max_wait / 1e3, stats.max_poll_gap_ns / 1e3, MAX_WAIT_NS / 1e3);
+    assert(events.handled > 0 && stats.collections == 20);
+    // Every event ended a pause, and the next one started after it ran
+    assert(stats.pause_count >= stats.collections + (uint64_t)events.handled);
+    gc_remove_root(head);
+}
+
+static size_t predicate_calls = 0;
+
+static int count_calls(void *arg) {
+    (void)arg;
+    predicate_calls++;
+    return 0;
+}
+
+// Polls for one full collection with the given bound on the work between them
+static size_t polls_per_collection(uint64_t max_wait_ns) {
+    gc_preemption_config_t config = {
+        .critical_event_pending = count_calls,
+        .check_interval = 64,
+        .max_wait_ns = max_wait_ns,
+    };
+    gc_set_preemption(&config);
+    predicate_calls = 0;
+    gc_collect_full();
+    gc_set_preemption(NULL);
+    return predicate_calls;
+}
+
+// Work between polls that takes longer than half the bound halves the interval, down
+// to a poll per object; a bound no work comes near keeps it at check_interval.
+void test_adaptive_interval() {
+    printf("=== Test: Adaptive Poll Interval ===\n");
+    gc_init();
+    object_t *head = build_heap();
+
+    size_t relaxed = polls_per_collection(UINT64_MAX);
+    size_t tight = polls_per_collection(1);
+    printf("%zu polls with the interval at 64, %zu with it shrunk\n", relaxed, tight);
+    assert(relaxed > 0 && tight > 16 * relaxed);
+    check_list(head);
+    gc_remove_root(head);
+}
+
+int main() {
+    test_resume_after_yield();
+    test_pending_at_entry();
+    test_bounded_wait();
+    test_adaptive_interval();
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "tb_gc.h"
+
+// Shadow stack roots: more than fit in one segment, popped in bulk, pushed from
+// several threads at once, changing on a running thread while another collects,
+// and held by a thread blocked while another collects.
+
+#define LOCALS 3000
+#define THREADS 4
+#define LOCALS_PER_THREAD 600
+#define COLLECTIONS 200
+#define MOVES 20000
+#define STAMP 0x5ca1ab1eULL
+
+void test_push_pop() {
+    printf("=== Test: Push / Pop ===\n");
+    gc_init();
+
+    static object_t *locals[LOCALS];
+    for (int i = 0; i < LOCALS; i++) {
+        locals[i] = gc_object_of(gc_alloc(16, 0));
+        gc_push_root(&locals[i]);
+    }
+
+    gc_collect_full();
+    for (int i = 0; i < LOCALS; i++) {
+        assert(findObj(locals[i]));
+    }
+    printf("%d shadow roots kept alive\n", LOCALS);
+
+    // Drop the top half; only the bottom half should survive
+    gc_pop_roots(LOCALS / 2);
+    gc_collect_full();
+    assert(findObj(locals[0]) && findObj(locals[LOCALS / 2 - 1]));
+    assert(!findObj(locals[LOCALS / 2]) && !findObj(locals[LOCALS - 1]));
+    printf("popped roots collected\n");
+
+    gc_pop_roots(LOCALS / 2);
+}
+
+void test_semispace_updates_slots() {
+    printf("=== Test: Semispace Slot Update ===\n");
+    gc_init_mode(GC_MODE_SEMISPACE);
+
+    object_t *a = gc_object_of(gc_alloc(16, 1));
+    object_t *b = gc_object_of(gc_alloc(16, 0));
+    gc_write_barrier(a, 0, b);
+    gc_push_root(&a);
+
+    object_t *before = a;
+    gc_collect_full();
+    assert(a != before && findObj(a));
+    assert(findObj(gc_get_child(a, 0)));
+    printf("local rewritten to %p\n", (void *)a);
+
+    gc_pop_roots(1);
+}
+
+static pthread_barrier_t pushed, collected;
+
+static void *mutator(void *arg) {
+    (void)arg;
+    object_t *locals[LOCALS_PER_THREAD];
+    for (int i = 0; i < LOCALS_PER_THREAD; i++) {
+        locals[i] = gc_object_of(gc_alloc(16, 0));
+        gc_push_root(&locals[i]);
+    }
+    // Stopped for the collection the main thread runs while this one waits
+    gc_blocking_begin();
+    pthread_barrier_wait(&pushed);
+    pthread_barrier_wait(&collected);
+    gc_blocking_end();
+    for (int i = 0; i < LOCALS_PER_THREAD; i++) {
+        assert(findObj(locals[i]));
+    }
+    gc_pop_roots(LOCALS_PER_THREAD);
+    return NULL;
+}
+
+void test_threads() {
+    printf("=== Test: Per-Thread Shadow Stacks ===\n");
+    gc_init();
+
+    pthread_t threads[THREADS];
+    pthread_barrier_init(&pushed, NULL, THREADS + 1);
+    pthread_barrier_init(&collected, NULL, THREADS + 1);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, mutator, NULL);
+    }
+    pthread_barrier_wait(&pushed);
+    gc_collect_full();
+    pthread_barrier_wait(&collected);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("roots from %d threads survived\n", THREADS);
+}
+
+static object_t *holder;
+static int collecting;
+static size_t moves;
+
+// Moves one object back and forth between a root and the holder's slot, allocating
+// garbage in between so it polls for the collector's stops. Freeing the object at
+// any point would show as a clobbered stamp.
+static void *mover(void *arg) {
+    (void)arg;
+    object_t *local = NULL;
+    gc_push_root(&local);
+    while (__atomic_load_n(&collecting, __ATOMIC_ACQUIRE)) {
+        local = gc_get_child(holder, 0);
+        gc_write_barrier(holder, 0, NULL);
+        *(uint64_t *)gc_alloc(16, 0) = 0;
+        assert(*(uint64_t *)gc_object_data(local) == STAMP);
+
+        gc_write_barrier(holder, 0, local);
+        local = NULL;
+        *(uint64_t *)gc_alloc(16, 0) = 0;
+        __atomic_fetch_add(&moves, 1, __ATOMIC_RELEASE);
+    }
+    gc_pop_roots(1);
+    return NULL;
+}
+
+void test_stopped_mutator() {
+    printf("=== Test: Roots Changing During Collection ===\n");
+    gc_init();
+    holder = gc_object_of(gc_alloc(16, 1));
+    gc_add_root(holder);
+    object_t *moved = gc_object_of(gc_alloc(16, 0));
+    *(uint64_t *)gc_object_data(moved) = STAMP;
+    gc_write_barrier(holder, 0, moved);
+
+    pthread_t thread;
+    collecting = 1;
+    pthread_create(&thread, NULL, mover, NULL);
+    // Collections interleave with moves, rather than all running before the first
+    for (int i = 0; i < COLLECTIONS || __atomic_load_n(&moves, __ATOMIC_ACQUIRE) < MOVES; i++) {
+        gc_collect_full();
+    }
+    __atomic_store_n(&collecting, 0, __ATOMIC_RELEASE);
+    // The mover may be collecting in its own allocations until it exits
+    gc_safepoint();
+    pthread_join(thread, NULL);
+
+    assert(gc_get_child(holder, 0) == moved && findObj(moved));
+    assert(*(uint64_t *)gc_object_data(moved) == STAMP);
+    gc_remove_root(holder);
+    printf("object survived %d collections and %zu moves\n", COLLECTIONS, moves);
+}
+
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int waiting, released;
+static object_t *kept;
+
+static void wait_at_gate(void) {
+    pthread_mutex_lock(&gate_lock);
+    waiting++;
+    pthread_cond_broadcast(&gate_cond);
+    while (!released) {
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    }
+    pthread_mutex_unlock(&gate_lock);
+}
+
+// Has allocated, so the heap knows it, but holds no roots and blocks unannounced
+static void *idle_main(void *arg) {
+    (void)arg;
+    for (int i = 0; i < 100; i++) {
+        gc_alloc(16, 0);
+    }
+    wait_at_gate();
+    return NULL;
+}
+
+// Holds a root across the wait, inside a blocking region
+static void *blocked_main(void *arg) {
+    (void)arg;
+    object_t *local = gc_object_of(gc_alloc(16, 0));
+    *(uint64_t *)gc_object_data(local) = STAMP;
+    gc_push_root(&local);
+    kept = local;
+
+    gc_blocking_begin();
+    wait_at_gate();
+    gc_blocking_end();
+
+    assert(local == kept && *(uint64_t *)gc_object_data(local) == STAMP);
+    gc_pop_roots(1);
+    return NULL;
+}
+
+void test_blocked_threads() {
+    printf("=== Test: Collecting Around Blocked Threads ===\n");
+    gc_init();
+    waiting = released = 0;
+    pthread_t idle, blocked;
+    pthread_create(&idle, NULL, idle_main, NULL);
+    pthread_create(&blocked, NULL, blocked_main, NULL);
+    pthread_mutex_lock(&gate_lock);
+    while (waiting < 2) {
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    }
+    pthread_mutex_unlock(&gate_lock);
+
+    for (int i = 0; i < 10; i++) {
+        gc_collect_full();
+    }
+    assert(findObj(kept));
+
+    pthread_mutex_lock(&gate_lock);
+    released = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    pthread_join(idle, NULL);
+    pthread_join(blocked, NULL);
+    printf("collections finished with one thread blocked unannounced and one in a blocking region\n");
+}
+
+int main() {
+    test_push_pop();
+    test_semispace_updates_slots();
+    test_threads();
+    test_stopped_mutator();
+    test_blocked_threads();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "tb_gc.h"
+#include "tb_stats.h"
+
+// Exercises the collector's statistics: phase times and collection counts for
+// known collections, object and byte counts freed, gc_reset_stats, and the pause
+// histogram's percentiles against injected values.
+
+#define LIVE_NODES 500
+#define GARBAGE 3000
+#define COLLECTIONS 4
+
+// A percentile is the upper bound of its bucket, so it may exceed the true value
+// by the bucket width - a quarter - but never fall below it.
+static int within_bucket(uint64_t reported, uint64_t expected) {
+    return reported >= expected && reported <= expected + expected / 4;
+}
+
+void test_histogram() {
+    printf("=== Test: Histogram Percentiles ===\n");
+    static tb_histogram_t hist;
+    memset(&hist, 0, sizeof(hist));
+
+    // 1 us .. 1 ms in 1 us steps, in scrambled order
+    for (uint64_t i = 0; i < 1000; i++) {
+        tb_histogram_record(&hist, ((i * 7919) % 1000 + 1) * 1000);
+    }
+    assert(hist.count == 1000 && hist.max == 1000000);
+    assert(hist.sum == 1000ULL * 1001 / 2 * 1000);
+
+    uint64_t p50 = tb_histogram_percentile(&hist, 0.50);
+    uint64_t p99 = tb_histogram_percentile(&hist, 0.99);
+    uint64_t p100 = tb_histogram_percentile(&hist, 1.0);
+    printf("p50 %llu  p99 %llu  max %llu\n", (unsigned long long)p50, (unsigned long long)p99,
+           (unsigned long long)p100);
+    assert(within_bucket(p50, 501000));
+    assert(within_bucket(p99, 991000));
+    assert(p100 == 1000000);
+
+    // Values below the sub-bucket count are exact
+    memset(&hist, 0, sizeof(hist));
+    tb_histogram_record(&hist, 1);
+    tb_histogram_record(&hist, 3);
+    assert(tb_histogram_percentile(&hist, 0.0) == 1 && tb_histogram_percentile(&hist, 1.0) == 3);
+
+    memset(&hist, 0, sizeof(hist));
+    assert(tb_histogram_percentile(&hist, 0.5) == 0);
+}
+
+static object_t *build_list(size_t n) {
+    object_t *head = NULL;
+    gc_push_root(&head);
+    for (size_t i = 0; i < n; i++) {
+        object_t *node = gc_object_of(gc_alloc(16, 1));
+        gc_write_barrier(node, 0, head);
+        head = node;
+    }
+    gc_pop_roots(1);
+    return head;
+}
+
+void test_collection_counters() {
+    printf("=== Test: Collection Counters ===\n");
+    gc_init();
+    gc_heap_policy_t policy = { .auto_collect = 0, .target_gc_ratio = 0.05, .target_live_ratio = 0.5, .max_heap_bytes = 0 };
+    gc_set_heap_policy(&policy);
+
+    object_t *live = build_list(LIVE_NODES);
+    gc_add_root(live);
+    gc_collect_full();
+    gc_reset_stats();
+
+    uint64_t longest = 0;
+    for (int c = 0; c < COLLECTIONS; c++) {
+        for (int i = 0; i < GARBAGE; i++) {
+            assert(gc_alloc(16, 1));
+        }
+        uint64_t start = tb_now_ns();
+        gc_collect_full();
+        uint64_t took = tb_now_ns() - start;
+        if (took > longest) longest = took;
+    }
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.collections == COLLECTIONS && stats.pause_count == COLLECTIONS);
+    assert(stats.root_scan_ns > 0 && stats.mark_ns > 0 && stats.sweep_ns > 0);
+    assert(stats.last_root_scan_ns <= stats.root_scan_ns && stats.last_mark_ns <= stats.mark_ns &&
+           stats.last_sweep_ns <= stats.sweep_ns);
+    assert(stats.pause_total_ns >= stats.root_scan_ns + stats.mark_ns + stats.sweep_ns);
+    assert(stats.objects_marked == (uint64_t)COLLECTIONS * LIVE_NODES);
+    assert(stats.objects_freed == (uint64_t)COLLECTIONS * GARBAGE);
+    // Each dead object is at least its header, payload and one child slot
+    assert(stats.bytes_freed >= stats.objects_freed * (sizeof(object_t) + 16 + sizeof(object_t *)));
+    assert(stats.pause_max_ns > 0 && stats.pause_max_ns <= longest);
+    assert(stats.pause_p50_ns <= stats.pause_max_ns + stats.pause_max_ns / 4);
+    printf("collections %llu  marked %llu  freed %llu objects, %llu bytes\n",
+           (unsigned long long)stats.collections, (unsigned long long)stats.objects_marked,
+           (unsigned long long)stats.objects_freed, (unsigned long long)stats.bytes_freed);
+
+    gc_reset_stats();
+    gc_get_stats(&stats);
+    assert(stats.collections == 0 && stats.pause_count == 0 && stats.pause_total_ns == 0);
+    assert(stats.root_scan_ns == 0 && stats.mark_ns == 0 && stats.sweep_ns == 0);
+    assert(stats.last_root_scan_ns == 0 && stats.last_mark_ns == 0 && stats.last_sweep_ns == 0);
+    assert(stats.objects_marked == 0 && stats.bytes_marked == 0);
+    assert(stats.objects_freed == 0 && stats.bytes_freed == 0);
+    assert(stats.pause_p50_ns == 0 && stats.pause_p99_ns == 0 && stats.pause_p999_ns == 0 &&
+           stats.pause_max_ns == 0);
+    // Gauges describe the heap as it is, not since the reset
+    assert(stats.heap_bytes > 0 && stats.heap_capacity_bytes > 0);
+    printf("reset cleared every counter\n");
+
+    gc_remove_root(live);
+    gc_set_heap_policy(NULL);
+}
+
+int main() {
+    test_histogram();
+    test_collection_counters();
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Exercises thread-local allocation buffers: several threads bump-allocating from
+// their own 8 KB chunks at once without their objects overlapping, the chunks they
+// leave behind being swept and freed by a collection, the refill taken when an
+// object is larger than what is left of the current chunk, and chunks swept while
+// their owners keep allocating in them.
+
+#define THREADS 4
+#define OBJECTS_PER_THREAD 400
+#define GARBAGE_PER_THREAD 600
+#define CHUNK_BYTES 8192
+#define BIG_OBJECT 2032  // With a header and one child slot, the largest object served from a TLAB
+
+// Automatic collection is off, so everything must fit the initial 1 MB arena
+
+typedef struct {
+    object_t **objects;
+    object_t *live;  // Every other object, linked through child 0
+    size_t live_count;
+    size_t garbage_bytes;
+} worker_t;
+
+// Bytes an object occupies in its chunk, rounded to the chunk's granule.
+static size_t extent(object_t *obj) {
+    size_t bytes = (size_t)((uint8_t *)gc_object_data(obj) - (uint8_t *)obj) + gc_object_size(obj) +
+                   sizeof(object_t *) * gc_object_child_count(obj);
+    return (bytes + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) * (object_t *const *)a;
+    uintptr_t y = (uintptr_t) * (object_t *const *)b;
+    return (x > y) - (x < y);
+}
+
+// Sizes cycle through small and TLAB-sized objects so chunks fill unevenly. The
+// payload is stamped with the owning thread and index to catch any overlap.
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    gc_push_root(&w->live);
+
+    // Objects that are dead from the start, filling chunks the thread retires
+    for (size_t i = 0; i < GARBAGE_PER_THREAD; i++) {
+        void *data = gc_alloc(16 + (i * 40) % 200, 0);
+        assert(data);
+        w->garbage_bytes += extent(gc_object_of(data));
+    }
+
+    for (size_t i = 0; i < OBJECTS_PER_THREAD; i++) {
+        size_t size = i % 97 == 0 ? BIG_OBJECT : 16 + (i * 24) % 300;
+        object_t *obj = gc_object_of(gc_alloc(size, 1));
+        assert(obj);
+        uint64_t *stamp = gc_object_data(obj);
+        stamp[0] = (uint64_t)(uintptr_t)w;
+        stamp[1] = i;
+        w->objects[i] = obj;
+        if (i % 2 == 0) {
+            gc_write_barrier(obj, 0, w->live);
+            w->live = obj;
+            w->live_count++;
+        }
+    }
+
+    gc_pop_roots(1);
+    return NULL;
+}
+
+static void check_stamps(worker_t *w, int live_only) {
+    for (size_t i = live_only; i < OBJECTS_PER_THREAD; i += 1 + live_only) {
+        uint64_t *stamp = gc_object_data(w->objects[i]);
+        assert(stamp[0] == (uint64_t)(uintptr_t)w && stamp[1] == i);
+    }
+}
+
+void test_concurrent_tlabs() {
+    printf("=== Test: Concurrent TLABs ===\n");
+    gc_init();
+    gc_heap_policy_t policy = { .auto_collect = 0, .target_gc_ratio = 0.05, .target_live_ratio = 0.5, .max_heap_bytes = 0 };
+    gc_set_heap_policy(&policy);
+    gc_collect_full();
+
+    worker_t workers[THREADS];
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        memset(&workers[t], 0, sizeof(workers[t]));
+        workers[t].objects = malloc(sizeof(object_t *) * OBJECTS_PER_THREAD);
+        pthread_create(&threads[t], NULL, worker_main, &workers[t]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        check_stamps(&workers[t], 0);
+        gc_add_root(workers[t].live);
+    }
+
+    // Sorted by address, every object ends at or before the next one starts
+    size_t total = (size_t)THREADS * OBJECTS_PER_THREAD;
+    object_t **all = malloc(sizeof(object_t *) * total);
+    for (int t = 0; t < THREADS; t++) {
+        memcpy(all + (size_t)t * OBJECTS_PER_THREAD, workers[t].objects, sizeof(object_t *) * OBJECTS_PER_THREAD);
+    }
+    qsort(all, total, sizeof(object_t *), compare_addresses);
+    for (size_t i = 1; i < total; i++) {
+        assert((uint8_t *)all[i - 1] + extent(all[i - 1]) <= (uint8_t *)all[i]);
+    }
+    free(all);
+    printf("%zu objects from %d threads, none overlapping\n", total, THREADS);
+
+    // The exited threads' chunks are no longer TLABs: those holding only garbage
+    // are freed whole, the rest keep their survivors
+    gc_stats_t before, after;
+    gc_get_stats(&before);
+    gc_collect_full();
+    gc_get_stats(&after);
+
+    size_t garbage_bytes = 0;
+    for (int t = 0; t < THREADS; t++) {
+        garbage_bytes += workers[t].garbage_bytes;
+        assert(findObj(workers[t].live));
+        check_stamps(&workers[t], 1);
+    }
+    assert(after.objects_freed - before.objects_freed ==
+           (uint64_t)THREADS * (GARBAGE_PER_THREAD + OBJECTS_PER_THREAD / 2));
+    assert(after.objects_marked - before.objects_marked >= (uint64_t)THREADS * OBJECTS_PER_THREAD / 2);
+    // Each thread's last garbage chunk may be shared with its first live objects
+    assert(before.heap_bytes - after.heap_bytes >= garbage_bytes - (size_t)THREADS * 2 * CHUNK_BYTES);
+    printf("collection freed %zu bytes of retired chunks\n", before.heap_bytes - after.heap_bytes);
+
+    for (int t = 0; t < THREADS; t++) {
+        gc_remove_root(workers[t].live);
+        free(workers[t].objects);
+    }
+    gc_collect_full();
+    gc_set_heap_policy(NULL);
+}
+
+// Fills a chunk with the largest TLAB objects until one no longer fits: that
+// allocation takes a fresh chunk, and what was left of the old one is abandoned.
+void test_refill() {
+    printf("=== Test: TLAB Refill ===\n");
+    gc_init();
+    gc_heap_policy_t policy = { .auto_collect = 0, .target_gc_ratio = 0.05, .target_live_ratio = 0.5, .max_heap_bytes = 0 };
+    gc_set_heap_policy(&policy);
+
+    object_t *objs[16] = { NULL };
+    for (int i = 0; i < 16; i++) {
+        gc_push_root(&objs[i]);
+    }
+
+    // Start from a fresh chunk: allocate until the heap grows
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    size_t heap_bytes = stats.heap_bytes;
+    do {
+        objs[0] = gc_object_of(gc_alloc(8, 0));
+        gc_get_stats(&stats);
+    } while (stats.heap_bytes == heap_bytes);
+    heap_bytes = stats.heap_bytes;
+
+    int refills = 0;
+    for (int i = 1; i < 16; i++) {
+        objs[i] = gc_object_of(gc_alloc(BIG_OBJECT, 0));
+        memset(gc_object_data(objs[i]), i, BIG_OBJECT);
+        gc_get_stats(&stats);
+        uint8_t *prev_end = (uint8_t *)objs[i - 1] + extent(objs[i - 1]);
+        if (stats.heap_bytes == heap_bytes) {
+            // Bumped straight after its predecessor in the same chunk
+            assert((uint8_t *)objs[i] == prev_end);
+        } else {
+            // Refilled: one new chunk, and the object starts it
+            assert(stats.heap_bytes - heap_bytes <= CHUNK_BYTES);
+            assert((uint8_t *)objs[i] != prev_end);
+            heap_bytes = stats.heap_bytes;
+            refills++;
+        }
+    }
+    // Objects of 2 KB fit three to a chunk, so they share chunks but take a new one
+    // every third allocation or so
+    assert(refills >= 4 && refills <= 8);
+
+    gc_collect_full();
+    for (int i = 1; i < 16; i++) {
+        uint8_t *data = gc_object_data(objs[i]);
+        assert(findObj(objs[i]) && data[0] == i && data[BIG_OBJECT - 1] == i);
+    }
+    printf("%d refills for 15 objects of %d bytes\n", refills, BIG_OBJECT);
+
+    gc_pop_roots(16);
+    gc_set_heap_policy(NULL);
+}
+
+#define SLOTS 64
+#define SWEEP_ROUNDS 200000
+
+static int sweeping_workers;
+
+// Keeps the last SLOTS objects it made in a rooted holder, checking each one's stamp
+// when it is replaced: an object whose chunk was swept from under its allocation
+// would have been freed and reused.
+static void *sweep_worker_main(void *arg) {
+    uint64_t id = (uint64_t)(uintptr_t)arg;
+    object_t *holder = gc_object_of(gc_alloc(8, SLOTS));
+    gc_push_root(&holder);
+    for (uint64_t i = 0; i < SWEEP_ROUNDS; i++) {
+        object_t *old = gc_get_child(holder, i % SLOTS);
+        if (old) {
+            uint64_t *stamp = gc_object_data(old);
+            assert(stamp[0] == id && stamp[1] == i - SLOTS);
+        }
+        object_t *obj = gc_object_of(gc_alloc(16 + (i % 7) * 8, 0));
+        uint64_t *stamp = gc_object_data(obj);
+        stamp[0] = id;
+        stamp[1] = i;
+        gc_write_barrier(holder, i % SLOTS, obj);
+    }
+    gc_pop_roots(1);
+    __atomic_fetch_sub(&sweeping_workers, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_sweep_while_allocating() {
+    printf("=== Test: Sweeping Owned Chunks ===\n");
+    gc_init();
+
+    pthread_t threads[THREADS];
+    sweeping_workers = THREADS;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, sweep_worker_main, (void *)(uintptr_t)(t + 1));
+    }
+    int collections = 0;
+    while (__atomic_load_n(&sweeping_workers, __ATOMIC_ACQUIRE)) {
+        gc_collect_full();
+        collections++;
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    printf("%d collections swept chunks being allocated in, no object lost\n", collections);
+}
+
+int main() {
+    test_concurrent_tlabs();
+    test_refill();
+    test_sweep_while_allocating();
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include "tb_gc.h"
+
+// Weak references and ephemeron tables in both collectors, and an ephemeron
+// memo cache that shrinks as its keys die.
+
+#define CACHE_KEYS 1000
+#define CACHE_KEPT 100
+
+static object_t *new_node(long value, size_t slots) {
+    object_t *obj = gc_object_of(gc_alloc(sizeof(long), slots));
+    *(long *)gc_object_data(obj) = value;
+    return obj;
+}
+
+static long node_value(object_t *obj) {
+    return *(long *)gc_object_data(obj);
+}
+
+void test_weak_references(gc_mode_t mode, const char *name) {
+    printf("=== Test: Weak References (%s) ===\n", name);
+    gc_init_mode(mode);
+    gc_reset_stats();
+
+    object_t *kept = new_node(1, 0);
+    object_t *dropped = new_node(2, 0);
+    object_t *weak = gc_object_of(gc_alloc_weak(0, 2));
+    gc_push_root(&kept);
+    gc_push_root(&weak);
+    gc_write_barrier(weak, 0, kept);
+    gc_write_barrier(weak, 1, dropped);
+
+    // A weak reference alone keeps nothing alive, and is cleared when its target dies
+    gc_collect_full();
+    assert(gc_get_child(weak, 0) == kept && node_value(kept) == 1);
+    assert(gc_get_child(weak, 1) == NULL);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.weak_refs_cleared == 1);
+
+    // Once the target is unrooted too, so is the other slot
+    kept = NULL;
+    gc_collect_full();
+    assert(gc_get_child(weak, 0) == NULL);
+    printf("weak slots cleared as their targets died\n");
+    gc_pop_roots(2);
+}
+
+void test_ephemerons(gc_mode_t mode, const char *name) {
+    printf("=== Test: Ephemerons (%s) ===\n", name);
+    gc_init_mode(mode);
+    gc_reset_stats();
+    gc_ephemeron_table_t *table = gc_ephemeron_table_create();
+
+    // key1 -> value1 -> key2 -> value2: value2 lives through value1's reference to
+    // key2, and value1 refers back to key1, which must not keep key1 alive
+    object_t *key1 = new_node(10, 0);
+    object_t *key2 = new_node(20, 0);
+    object_t *value1 = new_node(11, 2);
+    object_t *value2 = new_node(21, 0);
+    gc_write_barrier(value1, 0, key1);
+    gc_write_barrier(value1, 1, key2);
+    gc_ephemeron_table_put(table, key1, value1);
+    gc_ephemeron_table_put(table, key2, value2);
+    key2 = value1 = value2 = NULL;
+    gc_push_root(&key1);
+
+    gc_collect_full();
+    assert(gc_ephemeron_table_count(table) == 2);
+    value1 = gc_ephemeron_table_get(table, key1);
+    assert(value1 && node_value(value1) == 11 && gc_get_child(value1, 0) == key1);
+    key2 = gc_get_child(value1, 1);
+    assert(node_value(gc_ephemeron_table_get(table, key2)) == 21);
+    key2 = value1 = NULL;
+
+    // Dropping key1 takes both entries with it
+    key1 = NULL;
+    gc_collect_full();
+    assert(gc_ephemeron_table_count(table) == 0);
+
+    gc_stats_t stats;
+    gc_get_stats(&stats);
+    assert(stats.ephemerons_removed == 2);
+    printf("values lived exactly as long as their keys\n");
+
+    gc_pop_roots(1);
+    gc_ephemeron_table_destroy(table);
+}
+
+// A memo cache of derived values: only entries whose key the program still
+// holds survive a collection.
+void test_memo_cache() {
+    printf("=== Test: Memo Cache ===\n");
+    gc_init();
+    gc_ephemeron_table_t *cache = gc_ephemeron_table_create();
+
+    object_t *keys = gc_object_of(gc_alloc(0, CACHE_KEPT));
+    gc_push_root(&keys);
+    for (long i = 0; i < CACHE_KEYS; i++) {
+        object_t *key = new_node(i, 0);
+        if (i % (CACHE_KEYS / CACHE_KEPT) == 0) {
+            gc_write_barrier(keys, i / (CACHE_KEYS / CACHE_KEPT), key);
+        }
+        assert(gc_ephemeron_table_put(cache, key, new_node(i * i, 0)));
+    }
+    assert(gc_ephemeron_table_count(cache) == CACHE_KEYS);
+
+    gc_collect_full();
+    assert(gc_ephemeron_table_count(cache) == CACHE_KEPT);
+    for (size_t i = 0; i < CACHE_KEPT; i++) {
+        object_t *key = gc_get_child(keys, i);
+        object_t *value = gc_ephemeron_table_get(cache, key);
+        assert(value && node_value(value) == node_value(key) * node_value(key));
+    }
+    assert(gc_ephemeron_table_remove(cache, gc_get_child(keys, 0)));
+    assert(gc_ephemeron_table_count(cache) == CACHE_KEPT - 1);
+    printf("cache shrank from %d to %d entries\n", CACHE_KEYS, CACHE_KEPT);
+
+    gc_pop_roots(1);
+    gc_ephemeron_table_destroy(cache);
+}
+
+// Entries added while an incremental cycle is marking are resolved by the same cycle.
+void test_incremental() {
+    printf("=== Test: Incremental Ephemerons ===\n");
+    gc_init();
+    gc_ephemeron_table_t *table = gc_ephemeron_table_create();
+
+    // Enough live objects that marking takes several steps
+    object_t *chain = NULL;
+    gc_push_root(&chain);
+    for (long i = 0; i < 20000; i++) {
+        object_t *node = new_node(i, 1);
+        gc_write_barrier(node, 0, chain);
+        chain = node;
+    }
+
+    object_t *live = new_node(1, 0);
+    object_t *dead = new_node(2, 0);
+    object_t *weak = gc_object_of(gc_alloc_weak(0, 1));
+    gc_push_root(&live);
+    gc_push_root(&weak);
+
+    assert(gc_collect_step() == 0);
+    gc_ephemeron_table_put(table, live, new_node(3, 0));
+    gc_ephemeron_table_put(table, dead, new_node(4, 0));
+    gc_write_barrier(weak, 0, dead);
+    dead = NULL;
+    while (!gc_collect_step()) {
+    }
+
+    assert(gc_ephemeron_table_count(table) == 1);
+    assert(node_value(gc_ephemeron_table_get(table, live)) == 3);
+    assert(gc_get_child(weak, 0) == NULL);
+    printf("entries added mid-cycle resolved by that cycle\n");
+
+    gc_pop_roots(3);
+    gc_ephemeron_table_destroy(table);
+}
+
+int main() {
+    test_weak_references(GC_MODE_MARK_SWEEP, "mark-sweep");
+    test_weak_references(GC_MODE_SEMISPACE, "semispace");
+    test_ephemerons(GC_MODE_MARK_SWEEP, "mark-sweep");
+    test_ephemerons(GC_MODE_SEMISPACE, "semispace");
+    test_memo_cache();
+    test_incremental();
+    return 0;
+}